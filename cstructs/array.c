@@ -3,39 +3,220 @@
 // https://github.com/tylerneylon/cstructs
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // For mremap.
+#endif
+
 #include "array.h"
+#include "internal.h"
+#include "latency.h"
 
 #ifdef DEBUG
 #include "memprofile.h"
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Internal functions.
+// ===================
+
+// The header that array__save writes before the items. It's padded to 64
+// bytes so that mapped items are as aligned as heap items.
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t byte_order;  // file_byte_order, as written by the saving machine.
+  uint64_t item_size;
+  uint64_t count;
+  char     padding[32];
+} FileHeader;
+
+static const char file_magic[8] = "cstarray";
+#define file_version    1
+#define file_byte_order 0x01020304u
+
+static void free_items(Array array);
+
+#ifdef array__has_mmap
+
+static size_t mapping_bytes(size_t bytes) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (bytes + page - 1) / page * page;
+}
+
+// Moves the items into a mapping of at least bytes bytes; returns NULL if the
+// mapping can't be made, leaving the array as it was.
+static char *resize_mapping(Array array, size_t bytes) {
+  if (bytes > SIZE_MAX - (size_t)sysconf(_SC_PAGESIZE)) return NULL;
+  size_t new_len = mapping_bytes(bytes);
+  void *items;
+  if (array->storage == array__storage_mmap) {
+    // The kernel moves the page table entries; no item bytes are copied.
+    size_t old_len = mapping_bytes(array->capacity * array->item_size);
+    items = mremap(array->items, old_len, new_len, MREMAP_MAYMOVE);
+  } else {
+    items = mmap(NULL, new_len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if (items == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+  if (array->huge_pages) madvise(items, new_len, MADV_HUGEPAGE);
+#endif
+  if (array->storage != array__storage_mmap) {
+    // An empty array's items may be NULL, which memcpy mustn't be given.
+    if (array->count) {
+      memcpy(items, array->items, array->count * array->item_size);
+    }
+    free_items(array);
+    array->storage = array__storage_mmap;
+  }
+  return (char *)items;
+}
+
+#endif
+
+// Frees the items' memory according to how it was allocated.
+static void free_items(Array array) {
+  switch (array->storage) {
+    case array__storage_heap:
+      free(array->items);
+      break;
+#ifdef array__has_mmap
+    case array__storage_mmap:
+      munmap(array->items, mapping_bytes(array->capacity * array->item_size));
+      break;
+#endif
+#ifndef _WIN32
+    case array__storage_file:
+      munmap(array->items - sizeof(FileHeader),
+             sizeof(FileHeader) + array->capacity * array->item_size);
+      break;
+#endif
+  }
+}
+
+// Sets the capacity, which must be at least the count, and does not check for
+// overflow. Returns 0 if the memory couldn't be allocated.
+static int set_capacity(Array array, size_t capacity) {
+  size_t bytes = capacity * array->item_size;
+  char *items;
+#ifdef array__has_mmap
+  if (array->storage == array__storage_mmap ||
+      bytes >= array__mmap_threshold) {
+    items = resize_mapping(array, bytes);
+  } else
+#endif
+  if (array->storage == array__storage_inline ||
+      array->storage == array__storage_file) {
+    // Move the items to the heap, where they can grow.
+    items = malloc(bytes);
+    if (items) {
+      memcpy(items, array->items, array->count * array->item_size);
+      free_items(array);
+      array->storage = array__storage_heap;
+    }
+  } else {
+    items = realloc(array->items, bytes ? bytes : 1);
+  }
+  if (items == NULL) return 0;
+  array->items = items;
+  array->capacity = capacity;
+  return 1;
+}
+
+// Returns 1 if there's room for at least min_capacity items afterwards, and 0
+// if the capacity would overflow or the allocation failed. The array is
+// unchanged on failure.
+static int ensure_capacity(Array array, size_t min_capacity) {
+  if (min_capacity <= array->capacity) return 1;
+  size_t capacity = array->capacity ? array->capacity : 1;
+  // A factor of 1 or less grows one item at a time, so jump straight to the
+  // size needed rather than looping once per item.
+  if (!(array->growth_factor > 1)) capacity = min_capacity;
+  while (capacity < min_capacity) {
+    double next = capacity * array->growth_factor;
+    // This is also true when growth_factor is NaN.
+    if (!(next < (double)SIZE_MAX)) {
+      capacity = min_capacity;
+      break;
+    }
+    capacity = ((size_t)next > capacity) ? (size_t)next : capacity + 1;
+  }
+  size_t size = array->item_size ? array->item_size : 1;
+  if (capacity > SIZE_MAX / size) return 0;
+  if (set_capacity(array, capacity)) return 1;
+  // Growth may ask for much more than is needed; fall back to an exact fit.
+  return capacity > min_capacity && set_capacity(array, min_capacity);
+}
+
+
+// Public functions.
+// =================
 
-Array array__new(int capacity, size_t item_size) {
+Array array__new(size_t capacity, size_t item_size) {
   Array array = malloc(sizeof(ArrayStruct));
-  return array__init(array, capacity, item_size);
+  if (array == NULL) return NULL;
+  if (array__init(array, capacity, item_size) == NULL) {
+    free(array);
+    return NULL;
+  }
+  return array;
 }
 
-Array array__init(Array array, int capacity, size_t item_size) {
+Array array__init(Array array, size_t capacity, size_t item_size) {
   if (capacity < 1) capacity = 1;
   array->count = 0;
-  array->capacity = capacity;
+  array->capacity = 0;
   array->item_size = item_size;
   array->releaser = NULL;
-  if (capacity) {
-    array->items = malloc((int)item_size * capacity);
-  } else {
-    array->items = NULL;
-  }
+  array->items = NULL;
+  array->storage = array__storage_heap;
+  array->huge_pages = 0;
+  array->growth_factor = array__default_growth_factor;
+  if (!ensure_capacity(array, capacity)) return NULL;
+  return array;
+}
+
+Array array__new_inline(size_t capacity, size_t item_size) {
+  // The items follow the struct, padded so they're as aligned as malloc's.
+  size_t header = array__align_up(sizeof(ArrayStruct));
+  size_t size   = item_size ? item_size : 1;
+  if (capacity > (SIZE_MAX - header) / size) return NULL;
+  Array array = malloc(header + capacity * item_size);
+  if (array == NULL) return NULL;
+  return array__init_inline(array, (char *)array + header, capacity,
+                            item_size);
+}
+
+Array array__init_inline(Array array, void *buffer, size_t capacity,
+                         size_t item_size) {
+  array->count      = 0;
+  array->capacity   = capacity;
+  array->item_size  = item_size;
+  array->releaser   = NULL;
+  array->items      = (char *)buffer;
+  array->storage    = array__storage_inline;
+  array->huge_pages = 0;
+  array->growth_factor = array__default_growth_factor;
   return array;
 }
 
 void array__clear_with_context(Array array, void *context) {
   if (array->releaser) {
-    for (int i = 0; i < array->count; ++i) {
+    for (size_t i = 0; i < array->count; ++i) {
       array->releaser(array__item_ptr(array, i), context);
     }
   }
@@ -45,8 +226,10 @@ void array__clear_with_context(Array array, void *context) {
 void array__release_with_context(void *array, void *context) {
   Array a = (Array)array;
   array__clear_with_context(a, context);
-  free(a->items);
+  free_items(a);
+  a->items = NULL;
   a->capacity = 0;
+  a->storage = array__storage_heap;
 }
 
 void array__delete_with_context(Array array, void *context) {
@@ -66,33 +249,144 @@ void array__delete(Array array) {
   array__delete_with_context(array, NULL);  // NULL --> context
 }
 
-void *array__item_ptr(Array array, int index) {
+void array__use_huge_pages(Array array, int use_huge_pages) {
+  array->huge_pages = use_huge_pages;
+#if defined(array__has_mmap) && defined(MADV_HUGEPAGE)
+  if (array->storage == array__storage_mmap) {
+    madvise(array->items, mapping_bytes(array->capacity * array->item_size),
+            use_huge_pages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+  }
+#endif
+}
+
+int array__reserve(Array array, size_t capacity) {
+  if (capacity <= array->capacity) return 1;
+  size_t size = array->item_size ? array->item_size : 1;
+  if (capacity > SIZE_MAX / size) return 0;
+  return set_capacity(array, capacity);
+}
+
+int array__shrink_to_fit(Array array) {
+  // Inline buffers belong to the caller, and file mappings are already full.
+  if (array->storage == array__storage_inline ||
+      array->storage == array__storage_file ||
+      array->capacity == array->count) return 1;
+  size_t bytes = array->count * array->item_size;
+#ifdef array__has_mmap
+  if (array->storage == array__storage_mmap && bytes < array__mmap_threshold) {
+    // Move small arrays back to the heap, as set_capacity would never do.
+    char *items = malloc(bytes ? bytes : 1);
+    if (items == NULL) return 0;
+    memcpy(items, array->items, bytes);
+    free_items(array);
+    array->items    = items;
+    array->capacity = array->count;
+    array->storage  = array__storage_heap;
+    return 1;
+  }
+#endif
+  return set_capacity(array, array->count);
+}
+
+int array__save(Array array, const char *path) {
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, file_magic, sizeof(header.magic));
+  header.version    = file_version;
+  header.byte_order = file_byte_order;
+  header.item_size  = array->item_size;
+  header.count      = array->count;
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) return 0;
+  size_t num_bytes = array->count * array->item_size;
+  int did_write = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(array->items, 1, num_bytes, f) == num_bytes;
+  return (fclose(f) == 0) && did_write;
+}
+
+Array array__open_mapped(const char *path, size_t item_size) {
+  FileHeader header;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return NULL;
+  int is_valid = fread(&header, sizeof(header), 1, f) == 1 &&
+                 memcmp(header.magic, file_magic, sizeof(header.magic)) == 0 &&
+                 header.version    == file_version    &&
+                 header.byte_order == file_byte_order &&
+                 header.item_size  == item_size       && item_size > 0 &&
+                 header.count <= (SIZE_MAX - sizeof(header)) / item_size;
+  size_t num_bytes = is_valid ? header.count * item_size : 0;
+#ifndef _WIN32
+  struct stat st;
+  is_valid = is_valid && fstat(fileno(f), &st) == 0 &&
+             (uint64_t)st.st_size >= sizeof(header) + num_bytes;
+#endif
+  Array array = is_valid ? malloc(sizeof(ArrayStruct)) : NULL;
+  if (array == NULL) {
+    fclose(f);
+    return NULL;
+  }
+  array__init_inline(array, NULL, header.count, item_size);
+  array->count = header.count;
+
+#ifndef _WIN32
+  // A private mapping is copy-on-write: writes to the items touch only this
+  // process's copy of the pages they land on, never the file.
+  void *map = mmap(NULL, sizeof(header) + num_bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE, fileno(f), 0);
+  fclose(f);
+  if (map == MAP_FAILED) {
+    free(array);
+    return NULL;
+  }
+  array->items   = (char *)map + sizeof(header);
+  array->storage = array__storage_file;
+#else
+  // Without mmap, read the items into the heap instead.
+  array->items   = malloc(num_bytes ? num_bytes : 1);
+  array->storage = array__storage_heap;
+  int did_read = array->items &&
+                 fread(array->items, 1, num_bytes, f) == num_bytes;
+  fclose(f);
+  if (!did_read) {
+    free(array->items);
+    free(array);
+    return NULL;
+  }
+#endif
+  return array;
+}
+
+void *array__item_ptr(Array array, size_t index) {
   return (void *)(array->items + index * array->item_size);
 }
 
-void array__add_item_ptr(Array array, void *item) {
-  memcpy(array__new_ptr(array), item, array->item_size);
+void *array__add_item_ptr(Array array, void *item) {
+  void *new_item = array__new_ptr(array);
+  if (new_item) memcpy(new_item, item, array->item_size);
+  return new_item;
 }
 
 void *array__new_ptr(Array array) {
-  if (array->count == array->capacity) {
-    array->capacity *= 2;
-    if (array->capacity == 0) array->capacity = 1;
-    array->items = realloc(array->items,
-                           array->capacity * (int)array->item_size);
+  latency__start();
+  void *new_item = NULL;
+  if (array->count < SIZE_MAX && ensure_capacity(array, array->count + 1)) {
+    new_item = array__item_ptr(array, array->count++);
   }
-  array->count++;
-  return array__item_ptr(array, array->count - 1);
+  latency__end(latency__array_new_ptr);
+  return new_item;
 }
 
-void array__insert_items(Array array, int index, void *items, int num_items) {
+void *array__insert_items(Array array, size_t index,
+                          void *items, size_t num_items) {
   // array starts as <prefix> <suffix>; we'll move over <suffix> so it becomes
   //                 <prefix> <new-items> <suffix>.
-  long num_new_item_bytes = num_items * array->item_size;
-  // The order here is important. We want to use the original count first. The
-  // expansion may change array->items, so we only refer to it afterwards.
-  long num_suffix_bytes = (array->count - index) * array->item_size;
-  array__add_zeroed_items(array, num_items);
+  if (num_items > SIZE_MAX - array->count) return NULL;
+  size_t num_new_item_bytes = num_items * array->item_size;
+  size_t num_suffix_bytes = (array->count - index) * array->item_size;
+  if (!ensure_capacity(array, array->count + num_items)) return NULL;
+  array->count += num_items;
+  // The expansion may have changed array->items, so we only refer to it now.
   char *index_pt = (char *)array->items + index * array->item_size;
   memmove(index_pt + num_new_item_bytes,  // dst
           index_pt,                       // src
@@ -102,104 +396,1116 @@ void array__insert_items(Array array, int index, void *items, int num_items) {
   memcpy(index_pt,             // dst
          items,                // src
          num_new_item_bytes);  // len
+  return index_pt;
 }
 
-void array__append_array(Array dst, Array src) {
-  // We avoid using array__for since we don't know which type of pointer to use.
-  for (int i = 0; i < src->count; ++i) {
-    void *item = array__item_ptr(src, i);
-    array__add_item_ptr(dst, item);
-  }
+void *array__append_items(Array array, const void *items, size_t num_items) {
+  if (num_items > SIZE_MAX - array->count) return NULL;
+  // The items may be this array's own, which growth can move, so note their
+  // offset if so.
+  uintptr_t src = (uintptr_t)items, start = (uintptr_t)array->items;
+  int is_own = (src >= start &&
+                src < start + array->capacity * array->item_size);
+  if (!ensure_capacity(array, array->count + num_items)) return NULL;
+  if (is_own) items = array->items + (src - start);
+
+  char *new_items = array__item_ptr(array, array->count);
+  if (num_items) memcpy(new_items, items, num_items * array->item_size);
+  array->count += num_items;
+  return new_items;
 }
 
-int array__index_of(Array array, void *item) {
+void *array__append_array(Array dst, Array src) {
+  return array__append_items(dst, src->items, src->count);
+}
+
+size_t array__index_of(Array array, void *item) {
   ptrdiff_t byte_dist = (char *)item - array->items;
-  return (int)(byte_dist / array->item_size);
+  return (size_t)byte_dist / array->item_size;
 }
 
 void array__remove_item(Array array, void *item) {
   if (array->releaser) array->releaser(item, NULL);
-  int num_left = --(array->count);
+  size_t num_left = --(array->count);
   char *item_byte = (char *)item;
-  ptrdiff_t byte_dist = item_byte - array->items;
-  int index = (int)(byte_dist / array->item_size);
+  size_t index = array__index_of(array, item);
   if (index == num_left) return;
   memmove(item_byte, item_byte + array->item_size,
             (num_left - index) * array->item_size);
 }
 
-void array__add_zeroed_items(Array array, int num_items) {
-  int new_count = array->count + num_items;
-  int resize_needed = 0;
-  while (array->capacity < new_count) {
-    array->capacity *= 2;
-    if (array->capacity == 0) array->capacity = 1;
-    resize_needed = 1;
+void array__swap_remove(Array array, void *item) {
+  if (array->releaser) array->releaser(item, NULL);
+  char *last = array->items + --(array->count) * array->item_size;
+  if ((char *)item != last) memcpy(item, last, array->item_size);
+}
+
+// Moves the kept items from *run_start up to end down to *write_end, and
+// starts a new run just past end.
+static void close_kept_run(Array array, size_t *write_end, size_t *run_start,
+                           size_t end) {
+  size_t size = array->item_size;
+  size_t run_count = end - *run_start;
+  if (*write_end != *run_start && run_count) {
+    memmove(array->items + *write_end * size,
+            array->items + *run_start * size, run_count * size);
   }
-  if (resize_needed) {
-    array->items = realloc(array->items,
-                           array->capacity * (int)array->item_size);
+  *write_end += run_count;
+}
+
+size_t array__remove_if(Array array, array__Predicate should_remove,
+                        void *context) {
+  size_t n = array->count, write_end = 0, run_start = 0;
+  for (size_t i = 0; i < n; ++i) {
+    void *item = array__item_ptr(array, i);
+    if (!should_remove(item, context)) continue;
+    if (array->releaser) array->releaser(item, NULL);
+    close_kept_run(array, &write_end, &run_start, i);
+    run_start = i + 1;
+  }
+  close_kept_run(array, &write_end, &run_start, n);
+  array->count = write_end;
+  return n - write_end;
+}
+
+// Returns the index of the lowest set bit in word, which must be nonzero.
+static int lowest_bit(uint64_t word) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(word);
+#else
+  int i = 0;
+  for (; (word & 1) == 0; word >>= 1) ++i;
+  return i;
+#endif
+}
+
+// Returns the index of the first bit at or after i that equals bit, or n if
+// there's none. All-0 or all-1 words are skipped in one step.
+static size_t next_bit(const uint64_t *bits, size_t i, size_t n, int bit) {
+  while (i < n) {
+    uint64_t word = bits[i / 64];
+    if (!bit) word = ~word;
+    word >>= i % 64;
+    if (word) {
+      i += lowest_bit(word);
+      return i < n ? i : n;
+    }
+    i = (i / 64 + 1) * 64;
   }
+  return n;
+}
+
+size_t array__remove_masked(Array array, const uint64_t *remove_bits) {
+  size_t n = array->count, write_end = 0, run_start = 0;
+  size_t i = next_bit(remove_bits, 0, n, 1);
+  while (i < n) {
+    size_t removed_end = next_bit(remove_bits, i, n, 0);
+    if (array->releaser) {
+      for (size_t j = i; j < removed_end; ++j) {
+        array->releaser(array__item_ptr(array, j), NULL);
+      }
+    }
+    close_kept_run(array, &write_end, &run_start, i);
+    run_start = removed_end;
+    i = next_bit(remove_bits, removed_end, n, 1);
+  }
+  close_kept_run(array, &write_end, &run_start, n);
+  array->count = write_end;
+  return n - write_end;
+}
+
+void *array__add_zeroed_items(Array array, size_t num_items) {
+  if (num_items > SIZE_MAX - array->count) return NULL;
+  size_t new_count = array->count + num_items;
+  if (!ensure_capacity(array, new_count)) return NULL;
   void *bytes_to_zero = array__item_ptr(array, array->count);
   memset(bytes_to_zero, 0, num_items * array->item_size);
   array->count = new_count;
+  return bytes_to_zero;
+}
+
+// Linear scans.
+// =============
+//
+// Each scan compares whole vectors of items against copies of the needle,
+// then turns the comparison into a bit mask with one bit per byte. An item
+// matches when all of its bytes do, so a match's index is the mask's lowest
+// set bit divided by the item width, and the number of matches is the number
+// of set bits divided by the width. The kernels are inlined into one function
+// per (instruction set, width) pair so that the width is a constant.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define array__has_simd_scans
+#endif
+
+// Returns the index of the first item equal to needle, or n if none is.
+static always_inline size_t find_scalar(const char *items, size_t n,
+                                        const char *needle, size_t width) {
+  for (size_t i = 0; i < n; ++i) {
+    if (memcmp(items + i * width, needle, width) == 0) return i;
+  }
+  return n;
+}
+
+static always_inline size_t count_scalar(const char *items, size_t n,
+                                         const char *needle, size_t width) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    count += (memcmp(items + i * width, needle, width) == 0);
+  }
+  return count;
+}
+
+#ifdef array__has_simd_scans
+
+#include <immintrin.h>
+
+// SSE2 has no 64-bit compare, so 8-byte lanes match when both of their
+// 32-bit halves do.
+static always_inline __attribute__((target("sse2")))
+__m128i cmpeq_sse2(__m128i a, __m128i b, size_t width) {
+  __m128i eq;
+  switch (width) {
+    case 1:  return _mm_cmpeq_epi8(a, b);
+    case 2:  return _mm_cmpeq_epi16(a, b);
+    case 4:  return _mm_cmpeq_epi32(a, b);
+    default:
+      eq = _mm_cmpeq_epi32(a, b);
+      return _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0xb1));
+  }
+}
+
+static always_inline __attribute__((target("sse2")))
+size_t find_sse2(const char *items, size_t n, const char *needle,
+                 size_t width) {
+  __m128i needles = _mm_set1_epi8(0);
+  for (size_t i = 0; i < 16; i += width) {
+    memcpy((char *)&needles + i, needle, width);
+  }
+  size_t bytes = n * width, i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    __m128i eq0 = cmpeq_sse2(_mm_loadu_si128((__m128i *)(items + i)),
+                             needles, width);
+    __m128i eq1 = cmpeq_sse2(_mm_loadu_si128((__m128i *)(items + i + 16)),
+                             needles, width);
+    __m128i eq2 = cmpeq_sse2(_mm_loadu_si128((__m128i *)(items + i + 32)),
+                             needles, width);
+    __m128i eq3 = cmpeq_sse2(_mm_loadu_si128((__m128i *)(items + i + 48)),
+                             needles, width);
+    __m128i any = _mm_or_si128(_mm_or_si128(eq0, eq1), _mm_or_si128(eq2, eq3));
+    if (_mm_movemask_epi8(any) == 0) continue;
+    uint64_t mask = (uint64_t)(unsigned)_mm_movemask_epi8(eq0)         |
+                    (uint64_t)(unsigned)_mm_movemask_epi8(eq1) << 16   |
+                    (uint64_t)(unsigned)_mm_movemask_epi8(eq2) << 32   |
+                    (uint64_t)(unsigned)_mm_movemask_epi8(eq3) << 48;
+    return (i + __builtin_ctzll(mask)) / width;
+  }
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i eq = cmpeq_sse2(_mm_loadu_si128((__m128i *)(items + i)),
+                            needles, width);
+    unsigned mask = (unsigned)_mm_movemask_epi8(eq);
+    if (mask) return (i + __builtin_ctz(mask)) / width;
+  }
+  size_t done = i / width;
+  return done + find_scalar(items + i, n - done, needle, width);
+}
+
+static always_inline __attribute__((target("sse2")))
+size_t count_sse2(const char *items, size_t n, const char *needle,
+                  size_t width) {
+  __m128i needles = _mm_set1_epi8(0);
+  for (size_t i = 0; i < 16; i += width) {
+    memcpy((char *)&needles + i, needle, width);
+  }
+  size_t bytes = n * width, i = 0, matched_bytes = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i eq = cmpeq_sse2(_mm_loadu_si128((__m128i *)(items + i)),
+                            needles, width);
+    matched_bytes += __builtin_popcount((unsigned)_mm_movemask_epi8(eq));
+  }
+  size_t done = i / width;
+  return matched_bytes / width +
+         count_scalar(items + i, n - done, needle, width);
+}
+
+static always_inline __attribute__((target("avx2,popcnt")))
+__m256i cmpeq_avx2(__m256i a, __m256i b, size_t width) {
+  switch (width) {
+    case 1:  return _mm256_cmpeq_epi8(a, b);
+    case 2:  return _mm256_cmpeq_epi16(a, b);
+    case 4:  return _mm256_cmpeq_epi32(a, b);
+    default: return _mm256_cmpeq_epi64(a, b);
+  }
+}
+
+static always_inline __attribute__((target("avx2,popcnt")))
+size_t find_avx2(const char *items, size_t n, const char *needle,
+                 size_t width) {
+  __m256i needles = _mm256_setzero_si256();
+  for (size_t i = 0; i < 32; i += width) {
+    memcpy((char *)&needles + i, needle, width);
+  }
+  size_t bytes = n * width, i = 0;
+  for (; i + 128 <= bytes; i += 128) {
+    __m256i eq0 = cmpeq_avx2(_mm256_loadu_si256((__m256i *)(items + i)),
+                             needles, width);
+    __m256i eq1 = cmpeq_avx2(_mm256_loadu_si256((__m256i *)(items + i + 32)),
+                             needles, width);
+    __m256i eq2 = cmpeq_avx2(_mm256_loadu_si256((__m256i *)(items + i + 64)),
+                             needles, width);
+    __m256i eq3 = cmpeq_avx2(_mm256_loadu_si256((__m256i *)(items + i + 96)),
+                             needles, width);
+    __m256i any = _mm256_or_si256(_mm256_or_si256(eq0, eq1),
+                                  _mm256_or_si256(eq2, eq3));
+    if (_mm256_movemask_epi8(any) == 0) continue;
+    uint64_t lo = (uint64_t)(unsigned)_mm256_movemask_epi8(eq0) |
+                  (uint64_t)(unsigned)_mm256_movemask_epi8(eq1) << 32;
+    uint64_t hi = (uint64_t)(unsigned)_mm256_movemask_epi8(eq2) |
+                  (uint64_t)(unsigned)_mm256_movemask_epi8(eq3) << 32;
+    size_t offset = lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll(hi);
+    return (i + offset) / width;
+  }
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i eq = cmpeq_avx2(_mm256_loadu_si256((__m256i *)(items + i)),
+                            needles, width);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(eq);
+    if (mask) return (i + __builtin_ctz(mask)) / width;
+  }
+  size_t done = i / width;
+  return done + find_scalar(items + i, n - done, needle, width);
+}
+
+static always_inline __attribute__((target("avx2,popcnt")))
+size_t count_avx2(const char *items, size_t n, const char *needle,
+                  size_t width) {
+  __m256i needles = _mm256_setzero_si256();
+  for (size_t i = 0; i < 32; i += width) {
+    memcpy((char *)&needles + i, needle, width);
+  }
+  size_t bytes = n * width, i = 0, matched_bytes = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i eq = cmpeq_avx2(_mm256_loadu_si256((__m256i *)(items + i)),
+                            needles, width);
+    matched_bytes += __builtin_popcount((unsigned)_mm256_movemask_epi8(eq));
+  }
+  size_t done = i / width;
+  return matched_bytes / width +
+         count_scalar(items + i, n - done, needle, width);
+}
+
+#define define_scans(isa, target_isa, width)                            \
+  static __attribute__((noinline, target(target_isa)))                  \
+  size_t find_##isa##_##width(const char *items, size_t n,              \
+                              const char *needle) {                     \
+    return find_##isa(items, n, needle, width);                         \
+  }                                                                     \
+  static __attribute__((noinline, target(target_isa)))                  \
+  size_t count_##isa##_##width(const char *items, size_t n,             \
+                               const char *needle) {                    \
+    return count_##isa(items, n, needle, width);                        \
+  }
+
+define_scans(sse2, "sse2", 1)        define_scans(sse2, "sse2", 2)
+define_scans(sse2, "sse2", 4)        define_scans(sse2, "sse2", 8)
+define_scans(avx2, "avx2,popcnt", 1) define_scans(avx2, "avx2,popcnt", 2)
+define_scans(avx2, "avx2,popcnt", 4) define_scans(avx2, "avx2,popcnt", 8)
+
+#endif  // array__has_simd_scans
+
+typedef size_t (*ScanFunction)(const char *items, size_t n,
+                               const char *needle);
+
+// Returns the best find (or count) function for this CPU and item width, or
+// NULL if there's no vectorized one.
+static ScanFunction scan_function(size_t width, int is_count) {
+#ifdef array__has_simd_scans
+  static ScanFunction avx2[2][4] = {
+    {find_avx2_1, find_avx2_2, find_avx2_4, find_avx2_8},
+    {count_avx2_1, count_avx2_2, count_avx2_4, count_avx2_8}
+  };
+  static ScanFunction sse2[2][4] = {
+    {find_sse2_1, find_sse2_2, find_sse2_4, find_sse2_8},
+    {count_sse2_1, count_sse2_2, count_sse2_4, count_sse2_8}
+  };
+  int w;
+  switch (width) {
+    case 1:  w = 0; break;
+    case 2:  w = 1; break;
+    case 4:  w = 2; break;
+    case 8:  w = 3; break;
+    default: return NULL;
+  }
+  if (__builtin_cpu_supports("avx2")) return avx2[is_count][w];
+  if (__builtin_cpu_supports("sse2")) return sse2[is_count][w];
+#endif
+  return NULL;
+}
+
+void *array__find_linear(Array array, const void *item) {
+  size_t width = array->item_size, n = array->count;
+  ScanFunction find = scan_function(width, 0);  // 0 --> is_count
+  size_t index = find ? find(array->items, n, item)
+                      : find_scalar(array->items, n, item, width);
+  return index < n ? array__item_ptr(array, index) : NULL;
+}
+
+size_t array__count_equal(Array array, const void *item) {
+  size_t width = array->item_size, n = array->count;
+  ScanFunction count = scan_function(width, 1);  // 1 --> is_count
+  return count ? count(array->items, n, item)
+               : count_scalar(array->items, n, item, width);
 }
 
-static int compare_as_ints(void *item_size,
-                           const void *item1,
-                           const void *item2) {
-  size_t s = *(size_t *)item_size;
-  unsigned char *i1 = (unsigned char *)item1;
-  unsigned char *i2 = (unsigned char *)item2;
-  for (size_t i = 0; i < s; ++i) {
-    int diff = *(i1 + i) - *(i2 + i);
-    if (diff != 0) return diff;
+
+// Radix sorting.
+// ==============
+
+#define RADIX_INSERTION_CUTOFF 32
+
+typedef struct {
+  size_t start;
+  size_t count;
+  size_t byte;  // The items in this range agree on all earlier bytes.
+} RadixTask;
+
+// Insertion sort in memcmp order for items that agree before the given byte.
+static void insertion_sort_bytes(char *items, size_t n, size_t size,
+                                 size_t byte, char *tmp) {
+  for (size_t i = 1; i < n; ++i) {
+    memcpy(tmp, items + i * size, size);
+    size_t j = i;
+    for (; j > 0; --j) {
+      char *prev = items + (j - 1) * size;
+      if (memcmp(prev + byte, tmp + byte, size - byte) <= 0) break;
+      memcpy(prev + size, prev, size);
+    }
+    memcpy(items + j * size, tmp, size);
+  }
+}
+
+// Sorts items into memcmp order with an in-place MSD radix sort, also known as
+// American flag sort. It's unstable, but items that compare as equal are
+// byte-for-byte identical, so that can't be observed.
+static void radix_sort_bytes(char *base, size_t n, size_t size) {
+  char *tmp = malloc(size);
+  Array tasks = array__new(64, sizeof(RadixTask));
+  RadixTask first = { 0, n, 0 };
+  array__add_item_val(tasks, first);
+
+  size_t count[256], next[256], end[256];
+  while (tasks->count) {
+    RadixTask task = array__item_val(tasks, tasks->count - 1, RadixTask);
+    tasks->count--;
+    char *items = base + task.start * size;
+    if (task.count < RADIX_INSERTION_CUTOFF) {
+      insertion_sort_bytes(items, task.count, size, task.byte, tmp);
+      continue;
+    }
+
+    // Skip over bytes that every item in the range shares.
+    int num_buckets;
+    do {
+      memset(count, 0, sizeof(count));
+      for (size_t i = 0; i < task.count; ++i) {
+        count[(unsigned char)items[i * size + task.byte]]++;
+      }
+      num_buckets = 0;
+      for (int b = 0; b < 256; ++b) num_buckets += (count[b] > 0);
+    } while (num_buckets == 1 && ++task.byte < size);
+    if (task.byte == size) continue;
+
+    next[0] = 0;
+    for (int b = 1; b < 256; ++b) next[b] = next[b - 1] + count[b - 1];
+    for (int b = 0; b < 256; ++b) end[b] = next[b] + count[b];
+
+    // Cycle each item into its bucket; next[b] is where the next item that
+    // belongs in bucket b will go.
+    for (int b = 0; b < 256; ++b) {
+      while (next[b] < end[b]) {
+        char *item = items + next[b] * size;
+        unsigned char digit = (unsigned char)item[task.byte];
+        if (digit == b) {
+          next[b]++;
+          continue;
+        }
+        char *dst = items + next[digit]++ * size;
+        memcpy(tmp,  dst,  size);
+        memcpy(dst,  item, size);
+        memcpy(item, tmp,  size);
+      }
+    }
+
+    if (task.byte + 1 == size) continue;
+    for (int b = 0; b < 256; ++b) {
+      if (count[b] < 2) continue;
+      RadixTask subtask = { task.start + end[b] - count[b], count[b],
+                            task.byte + 1 };
+      array__add_item_val(tasks, subtask);
+    }
+  }
+
+  array__delete(tasks);
+  free(tmp);
+}
+
+typedef struct {
+  uint64_t key;
+  size_t   index;
+} KeyedIndex;
+
+// Returns the key as an unsigned value with the same ordering.
+static uint64_t ordered_key(const char *item, array__KeyType type) {
+  uint32_t u32;
+  uint64_t u64;
+  switch (type) {
+    case array__key_i32:
+      memcpy(&u32, item, 4);
+      return u32 ^ 0x80000000u;
+    case array__key_u32:
+      memcpy(&u32, item, 4);
+      return u32;
+    case array__key_i64:
+      memcpy(&u64, item, 8);
+      return u64 ^ 0x8000000000000000ull;
+    case array__key_u64:
+      memcpy(&u64, item, 8);
+      return u64;
+    case array__key_f32:
+      // Flip every bit of negatives, and only the sign bit of positives.
+      memcpy(&u32, item, 4);
+      return (u32 & 0x80000000u) ? ~u32 : u32 | 0x80000000u;
+    case array__key_f64:
+      memcpy(&u64, item, 8);
+      return (u64 & 0x8000000000000000ull) ? ~u64
+                                           : u64 | 0x8000000000000000ull;
   }
   return 0;
 }
 
-typedef int (*CompareFn)(void *context, const void *item1, const void *item2);
+uint64_t array__ordered_key(const void *key, array__KeyType type) {
+  return ordered_key((const char *)key, type);
+}
+
+static int key_width(array__KeyType type) {
+  return (type == array__key_i32 || type == array__key_u32 ||
+          type == array__key_f32) ? 4 : 8;
+}
+
+// An LSD radix sort of (key, index) pairs, followed by one pass to move each
+// item to its place.
+void array__sort_by_key(Array array, size_t key_offset, array__KeyType type) {
+  size_t n = array->count;
+  if (n < 2) return;
+  size_t size = array->item_size;
+  int num_digits = key_width(type);
+
+  KeyedIndex *keys     = malloc(n * sizeof(KeyedIndex));
+  KeyedIndex *scratch  = malloc(n * sizeof(KeyedIndex));
+  size_t (*count)[256] = calloc(num_digits, sizeof(*count));
+  for (size_t i = 0; i < n; ++i) {
+    keys[i].key   = ordered_key(array->items + i * size + key_offset, type);
+    keys[i].index = i;
+    for (int d = 0; d < num_digits; ++d) {
+      count[d][(keys[i].key >> (8 * d)) & 0xff]++;
+    }
+  }
+
+  for (int d = 0; d < num_digits; ++d) {
+    int shift = 8 * d;
+    // If every key has the same digit here, this pass would change nothing.
+    if (count[d][(keys[0].key >> shift) & 0xff] == n) continue;
+    size_t next[256];
+    next[0] = 0;
+    for (int b = 1; b < 256; ++b) next[b] = next[b - 1] + count[d][b - 1];
+    for (size_t i = 0; i < n; ++i) {
+      scratch[next[(keys[i].key >> shift) & 0xff]++] = keys[i];
+    }
+    KeyedIndex *swap = keys;
+    keys = scratch;
+    scratch = swap;
+  }
+
+  char *sorted = malloc(n * size);
+  for (size_t i = 0; i < n; ++i) {
+    memcpy(sorted + i * size, array->items + keys[i].index * size, size);
+  }
+  memcpy(array->items, sorted, n * size);
+
+  free(sorted);
+  free(count);
+  free(scratch);
+  free(keys);
+}
+
+
+// Comparison sorting and searching.
+// =================================
+//
+// These take the compare function and its context as parameters rather than
+// keeping them in statics, so any number of threads may sort at once.
+
+#define INSERTION_SORT_CUTOFF 16
+
+typedef struct {
+  size_t                 size;
+  array__CompareFunction compare;
+  void *                 context;
+} SortInfo;
+
+#define less_than(info, a, b) ((info)->compare((info)->context, (a), (b)) < 0)
+
+static void swap_items(char *a, char *b, size_t size) {
+  char tmp[64];
+  while (size) {
+    size_t n = size < sizeof(tmp) ? size : sizeof(tmp);
+    memcpy(tmp, a, n);
+    memcpy(a,   b, n);
+    memcpy(b, tmp, n);
+    a += n;
+    b += n;
+    size -= n;
+  }
+}
+
+static int compare_bytes(void *item_size,
+                         const void *item1,
+                         const void *item2) {
+  return memcmp(item1, item2, *(size_t *)item_size);
+}
+
+static void insertion_sort(char *items, size_t n, SortInfo *info) {
+  size_t size = info->size;
+  for (size_t i = 1; i < n; ++i) {
+    for (char *item = items + i * size;
+         item > items && less_than(info, item, item - size);
+         item -= size) {
+      swap_items(item, item - size, size);
+    }
+  }
+}
+
+static void sift_down(char *items, size_t root, size_t n, SortInfo *info) {
+  size_t size = info->size;
+  for (size_t child = 2 * root + 1; child < n; child = 2 * root + 1) {
+    if (child + 1 < n &&
+        less_than(info, items + child * size, items + (child + 1) * size)) {
+      child++;
+    }
+    if (!less_than(info, items + root * size, items + child * size)) return;
+    swap_items(items + root * size, items + child * size, size);
+    root = child;
+  }
+}
+
+static void heap_sort(char *items, size_t n, SortInfo *info) {
+  for (size_t i = n / 2; i-- > 0;) sift_down(items, i, n, info);
+  for (size_t end = n; end-- > 1;) {
+    swap_items(items, items + end * info->size, info->size);
+    sift_down(items, 0, end, info);
+  }
+}
+
+// Moves the median of the first, middle, and last items to the front.
+static void move_median_to_front(char *items, size_t n, SortInfo *info) {
+  size_t size = info->size;
+  char *a = items;
+  char *b = items + (n / 2) * size;
+  char *c = items + (n - 1) * size;
+  if (less_than(info, b, a)) { char *t = a; a = b; b = t; }
+  if (less_than(info, c, b)) {
+    b = c;
+    if (less_than(info, b, a)) b = a;
+  }
+  swap_items(items, b, size);
+}
+
+// Partitions the items around the median of the first, middle, and last ones,
+// and returns the pivot's final index. Items before it are not greater than
+// the pivot, and items after it are not less.
+static size_t partition(char *items, size_t n, SortInfo *info) {
+  size_t size = info->size;
+  move_median_to_front(items, n, info);
+
+  // Partition items[1..n-1] around the pivot at items[0]. Both scans stop at
+  // items equal to the pivot, which keeps runs of duplicates balanced.
+  size_t i = 1, j = n - 1;
+  while (1) {
+    while (i <= j && less_than(info, items + i * size, items)) i++;
+    while (i <= j && less_than(info, items, items + j * size)) j--;
+    if (i >= j) break;
+    swap_items(items + i * size, items + j * size, size);
+    i++;
+    j--;
+  }
+  swap_items(items, items + j * size, size);
+  return j;
+}
+
+// Returns the quicksort depth after which introsort and introselect give up
+// on partitioning and use heapsort.
+static int depth_limit_for(size_t n) {
+  int depth_limit = 0;
+  for (size_t m = n; m > 1; m >>= 1) depth_limit += 2;
+  return depth_limit;
+}
+
+// Introsort: quicksort that switches to heapsort after depth_limit levels,
+// and finishes small ranges with insertion sort.
+static void intro_sort(char *items, size_t n, int depth_limit, SortInfo *info) {
+  size_t size = info->size;
+  while (n > INSERTION_SORT_CUTOFF) {
+    if (depth_limit-- == 0) {
+      heap_sort(items, n, info);
+      return;
+    }
+    size_t j = partition(items, n, info);
+
+    // Recurse on the smaller side and loop on the larger one.
+    size_t num_left = j, num_right = n - j - 1;
+    char *right = items + (j + 1) * size;
+    if (num_left < num_right) {
+      intro_sort(items, num_left, depth_limit, info);
+      items = right;
+      n = num_right;
+    } else {
+      intro_sort(right, num_right, depth_limit, info);
+      n = num_left;
+    }
+  }
+  insertion_sort(items, n, info);
+}
+
+static void sort_items(char *items, size_t n, SortInfo *info) {
+  if (info->compare == NULL) {
+    radix_sort_bytes(items, n, info->size);
+    return;
+  }
+  intro_sort(items, n, depth_limit_for(n), info);
+}
 
-static CompareFn user_compare;
-static void *user_context;
+// Introselect: quickselect that only keeps the side holding the nth item, and
+// switches to heapsort after depth_limit levels. Expects nth < n.
+static void select_nth(char *items, size_t n, size_t nth, SortInfo *info) {
+  size_t size = info->size;
+  int depth_limit = depth_limit_for(n);
+  while (n > INSERTION_SORT_CUTOFF) {
+    if (depth_limit-- == 0) {
+      heap_sort(items, n, info);
+      return;
+    }
+    size_t j = partition(items, n, info);
+    if (nth == j) return;
+    if (nth < j) {
+      n = j;
+    } else {
+      items += (j + 1) * size;
+      nth   -= j + 1;
+      n     -= j + 1;
+    }
+  }
+  insertion_sort(items, n, info);
+}
 
-static int custom_compare(const void *item1, const void *item2) {
-  return user_compare(user_context, item1, item2);
+// A NULL compare means memcmp order; this fills in a compare function for the
+// algorithms that can't radix sort.
+static SortInfo compare_info(Array array, array__CompareFunction compare,
+                             void *compare_context) {
+  SortInfo info = { array->item_size, compare, compare_context };
+  if (compare == NULL) {
+    info.compare = compare_bytes;
+    info.context = &array->item_size;
+  }
+  return info;
+}
+
+static void merge(char *a, size_t a_len, char *b, size_t b_len, char *out,
+                  SortInfo *info) {
+  size_t size = info->size;
+  char *a_end = a + a_len * size, *b_end = b + b_len * size;
+  while (a < a_end && b < b_end) {
+    // Take from a on ties so that the merge is stable.
+    char **from = less_than(info, b, a) ? &b : &a;
+    memcpy(out, *from, size);
+    *from += size;
+    out += size;
+  }
+  memcpy(out, a, a_end - a);
+  memcpy(out + (a_end - a), b, b_end - b);
+}
+
+// A stable bottom-up merge sort. Runs of INSERTION_SORT_CUTOFF items are
+// sorted in place, then merged back and forth between items and buf, which
+// has room for n items. Returns where the sorted items ended up.
+static char *merge_sort(char *items, char *buf, size_t n, SortInfo *info) {
+  size_t size = info->size;
+  for (size_t start = 0; start < n; start += INSERTION_SORT_CUTOFF) {
+    size_t len = n - start < INSERTION_SORT_CUTOFF ? n - start
+                                                   : INSERTION_SORT_CUTOFF;
+    insertion_sort(items + start * size, len, info);
+  }
+  char *src = items, *dst = buf;
+  for (size_t width = INSERTION_SORT_CUTOFF; width < n; width *= 2) {
+    for (size_t start = 0; start < n; start += 2 * width) {
+      size_t a_len = n - start < width ? n - start : width;
+      size_t b_len = n - start - a_len < width ? n - start - a_len : width;
+      char *a = src + start * size, *b = a + a_len * size;
+      // Runs that are already in order are copied without a merge.
+      if (b_len == 0 || !less_than(info, b, b - size)) {
+        memcpy(dst + start * size, a, (a_len + b_len) * size);
+      } else {
+        merge(a, a_len, b, b_len, dst + start * size, info);
+      }
+    }
+    char *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  return src;
 }
 
 void array__sort(Array array,
                  array__CompareFunction compare,
                  void *compare_context) {
-  CompareFn old_compare = user_compare;
-  void *old_context = user_context;
+  SortInfo info = { array->item_size, compare, compare_context };
+  sort_items(array->items, array->count, &info);
+}
 
-  if (compare == NULL) {
-    user_compare = compare_as_ints;
-    user_context = &(array->item_size);
+void array__nth_element(Array array, size_t nth,
+                        array__CompareFunction compare,
+                        void *compare_context) {
+  if (nth >= array->count) return;
+  SortInfo info = compare_info(array, compare, compare_context);
+  select_nth(array->items, array->count, nth, &info);
+}
+
+void array__partial_sort(Array array, size_t k,
+                         array__CompareFunction compare,
+                         void *compare_context) {
+  SortInfo info = { array->item_size, compare, compare_context };
+  if (k < array->count) {
+    SortInfo select_info = compare_info(array, compare, compare_context);
+    select_nth(array->items, array->count, k, &select_info);
   } else {
-    user_compare = compare;
-    user_context = compare_context;
+    k = array->count;
   }
-  qsort(array->items, array->count, array->item_size, custom_compare);
-
-  user_compare = old_compare;
-  user_context = old_context;
+  sort_items(array->items, k, &info);
 }
 
-static size_t item_size;
+int array__top_k(Array out, Array array, size_t k,
+                 array__CompareFunction compare,
+                 void *compare_context) {
+  if (k > array->count) k = array->count;
+  if (k > SIZE_MAX - out->count || !array__reserve(out, out->count + k)) {
+    return 0;
+  }
+  SortInfo info = compare_info(array, compare, compare_context);
+  size_t size = array->item_size;
+  char *heap = (char *)array__item_ptr(out, out->count);
+  if (k == 0) return 1;
 
-static int compare_for_find(const void *a, const void *b) {
-  return memcmp(a, b, item_size);
+  // Keep the k least items seen so far in a max-heap, so that the root is
+  // the one to replace when a lesser item comes along.
+  memcpy(heap, array->items, k * size);
+  for (size_t i = k / 2; i-- > 0;) sift_down(heap, i, k, &info);
+  for (size_t i = k; i < array->count; ++i) {
+    char *item = array->items + i * size;
+    if (!less_than(&info, item, heap)) continue;
+    memcpy(heap, item, size);
+    sift_down(heap, 0, k, &info);
+  }
+  heap_sort(heap, k, &info);
+  out->count += k;
+  return 1;
+}
+
+int array__stable_sort(Array array,
+                       array__CompareFunction compare,
+                       void *compare_context) {
+  // Items that compare as equal in memcmp order are identical, so the
+  // unstable radix sort can't be told apart from a stable one.
+  size_t n = array->count, size = array->item_size;
+  if (compare == NULL || n <= INSERTION_SORT_CUTOFF) {
+    array__sort(array, compare, compare_context);
+    return 1;
+  }
+  char *buf = malloc(n * size);
+  if (buf == NULL) return 0;
+  SortInfo info = { size, compare, compare_context };
+  char *sorted = merge_sort(array->items, buf, n, &info);
+  if (sorted != array->items) memcpy(array->items, sorted, n * size);
+  free(buf);
+  return 1;
 }
 
 void *array__find(Array array, void *item) {
-  size_t old_size = item_size;
-  item_size = array->item_size;
-  void *found_val = bsearch(item,               // key
-                            array->items,       // data base ptr
-                            array->count,       // num items
-                            array->item_size,   // item width
-                            compare_for_find);  // cmp function
-  item_size = old_size;
-  return found_val;
+  size_t size = array->item_size;
+  size_t lo = 0, hi = array->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    char *mid_item = array->items + mid * size;
+    int cmp = memcmp(item, mid_item, size);
+    if (cmp == 0) return mid_item;
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return NULL;
+}
+
+
+size_t array__lower_bound(Array array, void *item,
+                          array__CompareFunction compare,
+                          void *compare_context) {
+  size_t size = array->item_size;
+  if (compare == NULL) {
+    compare = compare_bytes;
+    compare_context = &size;
+  }
+  size_t lo = 0, hi = array->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (compare(compare_context, array->items + mid * size, item) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t array__upper_bound(Array array, void *item,
+                          array__CompareFunction compare,
+                          void *compare_context) {
+  size_t size = array->item_size;
+  if (compare == NULL) {
+    compare = compare_bytes;
+    compare_context = &size;
+  }
+  size_t lo = 0, hi = array->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (compare(compare_context, item, array->items + mid * size) < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+#if defined(__GNUC__)
+#define prefetch(ptr) __builtin_prefetch(ptr)
+#else
+#define prefetch(ptr)
+#endif
+
+// The loop halves the range without branching on the comparison, so the
+// compiler can use a conditional move instead of a hard-to-predict branch.
+// Both possible next midpoints are prefetched while the current one loads.
+// There's one copy of the loop per key type to keep the key decoding out of
+// the loop body.
+#define branchless_lower_bound(type)                                 \
+  while (n > 1) {                                                    \
+    size_t half = n / 2;                                             \
+    prefetch(base + (half / 2) * size);                              \
+    prefetch(base + (half + half / 2) * size);                       \
+    base = (ordered_key(base + half * size, type) < target) ?        \
+           base + half * size : base;                                \
+    n -= half;                                                       \
+  }
+
+size_t array__lower_bound_by_key(Array array, size_t key_offset,
+                                 array__KeyType type, const void *key) {
+  size_t n = array->count;
+  if (n == 0) return 0;
+  size_t size = array->item_size;
+  uint64_t target = ordered_key((const char *)key, type);
+  char *base = array->items + key_offset;
+  switch (type) {
+    case array__key_i32: branchless_lower_bound(array__key_i32); break;
+    case array__key_u32: branchless_lower_bound(array__key_u32); break;
+    case array__key_i64: branchless_lower_bound(array__key_i64); break;
+    case array__key_u64: branchless_lower_bound(array__key_u64); break;
+    case array__key_f32: branchless_lower_bound(array__key_f32); break;
+    case array__key_f64: branchless_lower_bound(array__key_f64); break;
+  }
+  size_t index = (base - array->items - key_offset) / size;
+  return index + (ordered_key(base, type) < target);
+}
+
+
+// Parallel sorting.
+// =================
+//
+// Each thread sorts one chunk of the array, then rounds of pairwise merges
+// combine the sorted runs. A merge is itself split into pieces at matching
+// split points in its two inputs, so even the final merge uses every thread.
+
+typedef struct {
+  char * src;  // Where the merge inputs live, or the chunk to sort.
+  char * dst;  // Where the merged output goes.
+  size_t a_start, a_len;
+  size_t b_start, b_len;
+  size_t out_start;
+} SortTask;
+
+typedef struct {
+  SortInfo * info;
+  Array      tasks;  // An array of SortTask.
+  size_t     next_task;
+  int        is_merge;
+} SortJob;
+
+// Returns how many items of a are among the first k items of the stable merge
+// of a and b.
+static size_t merge_split(char *a, size_t a_len, char *b, size_t b_len,
+                          size_t k, SortInfo *info) {
+  size_t size = info->size;
+  size_t lo = k > b_len ? k - b_len : 0;
+  size_t hi = k < a_len ? k : a_len;
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2;  // Try taking i items from a.
+    size_t j = k - i - 1;           // ..and then b[j] would be in the output.
+    if (less_than(info, b + j * size, a + i * size)) {
+      hi = i;
+    } else {
+      lo = i + 1;
+    }
+  }
+  return lo;
+}
+
+static void run_sort_task(SortJob *job, SortTask *task) {
+  size_t size = job->info->size;
+  if (!job->is_merge) {
+    sort_items(task->src + task->a_start * size, task->a_len, job->info);
+    return;
+  }
+  merge(task->src + task->a_start * size, task->a_len,
+        task->src + task->b_start * size, task->b_len,
+        task->dst + task->out_start * size, job->info);
+}
+
+static size_t claim_sort_task(SortJob *job) {
+#ifdef _WIN32
+  return job->next_task++;
+#else
+  return __sync_fetch_and_add(&job->next_task, 1);
+#endif
+}
+
+static void *sort_worker(void *job_ptr) {
+  SortJob *job = (SortJob *)job_ptr;
+  for (size_t t = claim_sort_task(job);
+       t < job->tasks->count;
+       t = claim_sort_task(job)) {
+    run_sort_task(job, (SortTask *)array__item_ptr(job->tasks, t));
+  }
+  return NULL;
+}
+
+static void run_sort_job(SortJob *job, int num_threads) {
+  job->next_task = 0;
+#ifndef _WIN32
+  if ((size_t)num_threads > job->tasks->count) {
+    num_threads = (int)job->tasks->count;
+  }
+  if (num_threads > 1) {
+    pthread_t *threads = malloc((num_threads - 1) * sizeof(pthread_t));
+    for (int i = 0; i < num_threads - 1; ++i) {
+      pthread_create(&threads[i], NULL, sort_worker, job);
+    }
+    sort_worker(job);
+    for (int i = 0; i < num_threads - 1; ++i) pthread_join(threads[i], NULL);
+    free(threads);
+    return;
+  }
+#endif
+  sort_worker(job);
+}
+
+// Adds tasks that merge runs a and b of src into dst, split into num_pieces
+// pieces of about equal size.
+static void add_merge_tasks(SortJob *job, char *src, char *dst,
+                            size_t a_start, size_t a_len,
+                            size_t b_start, size_t b_len, int num_pieces) {
+  size_t size = job->info->size;
+  char *a = src + a_start * size, *b = src + b_start * size;
+  size_t total = a_len + b_len;
+  size_t prev_k = 0, prev_i = 0;
+  for (int p = 1; p <= num_pieces; ++p) {
+    size_t k = total * p / num_pieces;
+    size_t i = a_len;
+    if (p < num_pieces) i = merge_split(a, a_len, b, b_len, k, job->info);
+    SortTask task = { src, dst,
+                      a_start + prev_i, i - prev_i,
+                      b_start + (prev_k - prev_i), (k - i) - (prev_k - prev_i),
+                      a_start + prev_k };
+    array__add_item_val(job->tasks, task);
+    prev_k = k;
+    prev_i = i;
+  }
+}
+
+void array__parallel_sort(Array array,
+                          array__CompareFunction compare,
+                          void *compare_context,
+                          int num_threads) {
+  size_t n = array->count;
+  size_t size = array->item_size;
+  if (num_threads < 2 || n < 2 * (size_t)num_threads) {
+    array__sort(array, compare, compare_context);
+    return;
+  }
+
+  // Sorted runs are merged with compare, so a NULL compare needs a stand-in.
+  SortInfo chunk_info = { size, compare, compare_context };
+  SortInfo merge_info = compare_info(array, compare, compare_context);
+
+  SortJob job = { &chunk_info, NULL, 0, 0 };
+  job.tasks = array__new(num_threads, sizeof(SortTask));
+
+  // Sort one chunk per thread; run r is items bounds[r] to bounds[r + 1] - 1.
+  size_t num_runs = num_threads;
+  size_t *bounds = malloc((num_runs + 1) * sizeof(size_t));
+  for (size_t r = 0; r <= num_runs; ++r) bounds[r] = n * r / num_runs;
+  for (size_t r = 0; r < num_runs; ++r) {
+    SortTask task = { array->items, NULL, bounds[r], bounds[r + 1] - bounds[r],
+                      0, 0, 0 };
+    array__add_item_val(job.tasks, task);
+  }
+  run_sort_job(&job, num_threads);
+
+  // Merge pairs of runs until one is left.
+  char *src = array->items, *dst = malloc(n * size);
+  char *scratch = dst;
+  job.info = &merge_info;
+  job.is_merge = 1;
+  while (num_runs > 1) {
+    array__clear(job.tasks);
+    size_t num_merges = num_runs / 2;
+    int pieces = (int)((num_threads + num_merges - 1) / num_merges);
+    for (size_t r = 0; r < num_runs; r += 2) {
+      size_t a = bounds[r], b = bounds[r + 1];
+      // An unpaired last run is merged with nothing, which copies it over.
+      size_t end = (r + 2 <= num_runs) ? bounds[r + 2] : b;
+      add_merge_tasks(&job, src, dst, a, b - a, b, end - b,
+                      end > b ? pieces : 1);
+      bounds[r / 2] = a;
+    }
+    run_sort_job(&job, num_threads);
+
+    num_runs = (num_runs + 1) / 2;
+    bounds[num_runs] = n;
+    char *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != array->items) memcpy(array->items, src, n * size);
+  free(scratch);
+  free(bounds);
+  array__delete(job.tasks);
 }
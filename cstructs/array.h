@@ -10,16 +10,58 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 typedef void (*Releaser)(void *item, void *context);
 
+// The alignment that malloc guarantees, which is _Alignof(max_align_t) in
+// C11; array__align_up rounds a size up to a multiple of it. Items kept just
+// after a struct in the same block start at an aligned offset this way.
 typedef struct {
-  int      count;
-  int      capacity;
+  char c;
+  union { long double ld; long long ll; void *p; void (*f)(void); } u;
+} array__AlignProbe;
+#define array__max_align offsetof(array__AlignProbe, u)
+#define array__align_up(size) \
+  (((size) + array__max_align - 1) / array__max_align * array__max_align)
+
+// Where an array's items live. Arrays start out on the heap; on Linux, once
+// the items need at least array__mmap_threshold bytes, they move into their
+// own anonymous memory mapping. A mapping grows with mremap, which moves page
+// table entries rather than copying items. Inline storage is a fixed buffer
+// supplied with array__init_inline; the items move to the heap, or to a
+// mapping, once they outgrow it. File storage is a copy-on-write mapping of
+// a file made by array__open_mapped; it's copied to the heap if it grows.
+typedef enum {
+  array__storage_heap,
+  array__storage_mmap,
+  array__storage_inline,
+  array__storage_file
+} array__Storage;
+
+#ifdef __linux__
+#define array__has_mmap
+#endif
+
+#define array__mmap_threshold (32 << 20)
+
+#define array__default_growth_factor 2.0
+
+typedef struct {
+  size_t   count;
+  size_t   capacity;
   size_t   item_size;
   Releaser releaser;
   char *   items;
+  int      storage;     // An array__Storage value.
+  int      huge_pages;  // Set this with array__use_huge_pages.
+
+  // The capacity is multiplied by this when the array must grow. The default
+  // of 2 copies the least; a value such as 1.5 wastes less memory on large
+  // arrays. Values of 1 or less grow by a single item at a time.
+  double   growth_factor;
 } ArrayStruct;
 
 typedef ArrayStruct *Array;
@@ -27,11 +69,51 @@ typedef ArrayStruct *Array;
 
 // Constant-time operations.
 
-// Allocates and initializes a new array.
-Array array__new  (int capacity, size_t item_size);
+// Allocates and initializes a new array. Returns NULL if the capacity in bytes
+// would overflow a size_t or the allocation fails.
+Array array__new  (size_t capacity, size_t item_size);
+
+// For use on an allocated but uninitialized array struct; returns NULL on
+// failure, just like array__new.
+Array array__init (Array array, size_t capacity, size_t item_size);
 
-// For use on an allocated but uninitialized array struct.
-Array array__init (Array array, int capacity, size_t item_size);
+// Small-buffer arrays. These keep their first capacity items in a buffer
+// that isn't separately allocated, so short arrays need one malloc, or none.
+// array__new_inline allocates the struct and its buffer in one block, and
+// array__delete frees both. array__init_inline uses a buffer you provide,
+// which must outlive the array; array__release frees only what was spilled to
+// the heap. The array__inline_struct macros below set up both parts at once.
+Array array__new_inline  (size_t capacity, size_t item_size);
+Array array__init_inline (Array array, void *buffer, size_t capacity,
+                          size_t item_size);
+
+// Example, for an array of up to 4 ints on the stack:
+//
+//   array__inline_struct(int, 4) tags_struct;
+//   Array tags = array__init_inline_struct(&tags_struct);
+//   /* Use tags like any other Array. */
+//   array__release(tags);
+#define array__inline_struct(type, n)                           \
+  struct { ArrayStruct array; type inline_items[n]; }
+#define array__init_inline_struct(s)                            \
+  array__init_inline(&(s)->array, (s)->inline_items,            \
+                     sizeof((s)->inline_items) /                \
+                         sizeof(*(s)->inline_items),            \
+                     sizeof(*(s)->inline_items))
+
+// Writes a small header followed by the items to the file at path, replacing
+// it if it exists. Returns 1 on success and 0 on failure. Items are written
+// as raw bytes, so they shouldn't hold pointers.
+int   array__save        (Array array, const char *path);
+
+// Returns an array whose items are a memory mapping of a file written by
+// array__save, so opening even a very large file is fast; pages are read in
+// as they're used. Returns NULL if the file can't be read, isn't an array
+// file, was written with a different byte order, or has items that aren't
+// item_size bytes. The mapping is private: the array may be changed like any
+// other, and each page is copied when it's first written, but the changes
+// never reach the file. Free it with array__delete.
+Array array__open_mapped (const char *path, size_t item_size);
 
 
 // The next three methods are O(1) if there's no releaser; O(n) if there is.
@@ -44,26 +126,67 @@ void array__clear_with_context   (Array array, void *context);
 void array__release_with_context (void *array, void *context);
 void array__delete_with_context  (Array array, void *context);
 
-void *  array__item_ptr(Array array, int index);
+// Asks for transparent huge pages for the array's items whenever they're in
+// a memory mapping, now or after later growth. Huge pages mean fewer TLB
+// misses when scanning large arrays. This is only a hint, and has no effect
+// on heap storage or on systems without madvise(MADV_HUGEPAGE).
+void array__use_huge_pages(Array array, int use_huge_pages);
+
+// Makes room for at least capacity items, growing to exactly that many if
+// needed, so that later additions up to it don't reallocate. Returns 1 on
+// success and 0 on failure, which leaves the array unchanged.
+int  array__reserve(Array array, size_t capacity);
+
+// Frees any capacity beyond the count; large arrays that now fit under
+// array__mmap_threshold move back to the heap. Inline and file-mapped arrays
+// are left as they are. Returns 0, leaving the array unchanged, on failure.
+int  array__shrink_to_fit(Array array);
+
+void *  array__item_ptr(Array array, size_t index);
 #define array__item_val(array, i, type) (*(type *)array__item_ptr(array, i))
 
 // Amortized constant-time operations (usually constant-time, sometimes linear).
 
-void    array__add_item_ptr(Array array, void *item);
+// Functions that grow the array return a pointer to the first new item. They
+// return NULL, and leave the array unchanged, if the new size in bytes would
+// overflow a size_t or the allocation fails.
+
+void *  array__add_item_ptr(Array array, void *item);
 #define array__add_item_val(a, i) array__add_item_ptr(a, &i);
 void *  array__new_ptr(Array array);
 #define array__new_val(a, type) (*(type *)array__new_ptr(a))
 
 // Possibly linear time operations.
 
-void array__insert_items (Array array, int index, void *items, int num_items);
-void array__append_array (Array dst, Array src);  // Expects dst != src.
-int  array__index_of     (Array array, void *item);
+void * array__insert_items (Array array, size_t index,
+                            void *items, size_t num_items);
+
+// These grow the array at most once and copy the new items with one memcpy.
+// The items may come from the array itself, and src may be dst.
+void * array__append_items (Array array, const void *items, size_t num_items);
+void * array__append_array (Array dst, Array src);
+size_t array__index_of     (Array array, void *item);
 
 // The item is expected to be an object already within the array, i.e.,
 // the location of item should be in the array->items memory buffer.
-void array__remove_item      (Array array, void *item);
-void array__add_zeroed_items (Array array, int num_items);
+void   array__remove_item      (Array array, void *item);
+void * array__add_zeroed_items (Array array, size_t num_items);
+
+// Removes the item in O(1) time by moving the last item into its place, so
+// the order of the remaining items changes. The item is expected to be within
+// the array, just as for array__remove_item.
+void   array__swap_remove      (Array array, void *item);
+
+typedef int (*array__Predicate)(void *item, void *context);
+
+// These remove many items in one linear pass, keeping the order of the rest;
+// removed items are released. The first removes items for which
+// should_remove returns nonzero. The second removes item i when bit i % 64 of
+// remove_bits[i / 64] is set, and skips 64 items at a time over words of all
+// 0s or all 1s. Both return the number of items removed.
+size_t array__remove_if     (Array array, array__Predicate should_remove,
+                             void *context);
+size_t array__remove_masked (Array array, const uint64_t *remove_bits);
 
 // Loop over an array.
 // Example: array__for(item_type *, item_ptr, array, index) { /* loop body */ }
@@ -73,9 +196,9 @@ void array__add_zeroed_items (Array array, int num_items);
 // expected to be "x *" (a pointer to x). It is safe to continue or break, edit
 // the index, and to edit the array itself, although array changes - including
 // *any* additions at all - may invalidate item_ptr until the start of the next
-// iteration.
+// iteration. The index has type size_t.
 #define array__for(type, item_ptr, array, index)            \
-  for (int index = 0, __tmpvar = 1; __tmpvar--;)            \
+  for (size_t index = 0, __tmpvar = 1; __tmpvar--;)         \
   for (type item_ptr = (type)array__item_ptr(array, index); \
        index < array->count;                                \
        item_ptr = (type)array__item_ptr(array, ++index))
@@ -83,10 +206,91 @@ void array__add_zeroed_items (Array array, int num_items);
 
 typedef int (*array__CompareFunction)(void *, const void *, const void *);
 
+// If compare is NULL, items are sorted in memcmp order with a radix sort.
+// Sorting is reentrant, so different threads may sort at the same time.
 void array__sort(Array array,
                  array__CompareFunction compare,
                  void *compare_context);
 
+// Sorts chunks of the array on num_threads threads, then merges the sorted
+// runs, again in parallel. The compare function may be called concurrently.
+void array__parallel_sort(Array array,
+                          array__CompareFunction compare,
+                          void *compare_context,
+                          int num_threads);
+
+// Selection. Like array__sort, these take a NULL compare to mean memcmp order.
+// For the greatest items rather than the least, reverse the compare function.
+
+// Moves the item that would be at index nth after sorting to that index, with
+// no greater items before it and no lesser items after it, in O(n) expected
+// time. Does nothing if nth is not below the count.
+void array__nth_element(Array array, size_t nth,
+                        array__CompareFunction compare,
+                        void *compare_context);
+
+// Sorts the k least items into the first k places, in O(n + k log k)
+// expected time; the rest are left in no particular order.
+void array__partial_sort(Array array, size_t k,
+                         array__CompareFunction compare,
+                         void *compare_context);
+
+// Appends the k least items of array to out, sorted, leaving array unchanged.
+// This keeps a bounded heap of k items in out, so it takes O(n log k) time and
+// no other memory. Returns 0, leaving out unchanged, if out can't grow.
+int  array__top_k(Array out, Array array, size_t k,
+                  array__CompareFunction compare,
+                  void *compare_context);
+
+// A merge sort that keeps equal items in their original order. It allocates
+// a buffer as large as the items, and returns 0, leaving the array unchanged,
+// if it can't; otherwise it returns 1.
+int  array__stable_sort(Array array,
+                        array__CompareFunction compare,
+                        void *compare_context);
+
+// Numeric key types for the keyed functions below. Signed and floating-point
+// keys are ordered numerically; negative NaNs sort first and positive NaNs
+// sort last.
+typedef enum {
+  array__key_i32,
+  array__key_u32,
+  array__key_i64,
+  array__key_u64,
+  array__key_f32,
+  array__key_f64
+} array__KeyType;
+
+// Stable radix sort by the numeric key found key_offset bytes into each item.
+void array__sort_by_key(Array array, size_t key_offset, array__KeyType type);
+
+// Returns the key as an unsigned value whose order matches the key's order.
+uint64_t array__ordered_key(const void *key, array__KeyType type);
+
 // Assumes the array is sorted in ascending memcmp order; does a memcmp of
 // each item in the array, using a binary search.
 void *array__find(Array array, void *item);
+
+// These compare item to every item in the array, which needn't be sorted.
+// The first returns a pointer to the first item with the same bytes as item,
+// or NULL if there's none; the second returns how many items have the same
+// bytes. Items of 1, 2, 4, or 8 bytes are compared with SSE2 or AVX2 vector
+// instructions when the CPU supports them.
+void * array__find_linear (Array array, const void *item);
+size_t array__count_equal (Array array, const void *item);
+
+// These expect the array to be sorted by compare; a NULL compare means memcmp
+// order. The lower bound is the index of the first item not less than item,
+// and the upper bound is the index of the first item greater than item. Both
+// are array->count if there's no such item.
+size_t array__lower_bound(Array array, void *item,
+                          array__CompareFunction compare,
+                          void *compare_context);
+size_t array__upper_bound(Array array, void *item,
+                          array__CompareFunction compare,
+                          void *compare_context);
+
+// A branch-free lower bound for arrays sorted by a numeric key, as done by
+// array__sort_by_key; key points to a value of the given type.
+size_t array__lower_bound_by_key(Array array, size_t key_offset,
+                                 array__KeyType type, const void *key);
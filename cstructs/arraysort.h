@@ -0,0 +1,302 @@
+// arraysort.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A macro that defines a sort function specialized to one item type and one
+// ordering. The ordering is inlined into the sort, so it avoids the indirect
+// function call per comparison that array__sort makes.
+//
+// Example:
+//
+//   typedef struct { int key; float value; } Row;
+//   array__define_sort(sort_rows, Row, a->key < b->key)
+//
+//   sort_rows(array);                // Sorts an Array of Row items.
+//   sort_rows_items(rows, num_rows);  // Sorts a plain C array of Row items.
+//
+// The less_expr parameter is an expression that's true when the item a points
+// to belongs before the item b points to; a and b have type `const type *`.
+//
+// The sort is a pattern-defeating quicksort (pdqsort, by Orson Peters). Its
+// partitioning is branchless in the style of BlockQuicksort. It has
+// linear-time cases for sorted and reverse-sorted input and for runs of equal
+// items, and falls back to heapsort to guarantee O(n log n). It is not
+// stable.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stddef.h>
+
+#define array__sort_insertion_threshold     24
+#define array__sort_ninther_threshold      128
+#define array__sort_partial_insertion_limit  8
+#define array__sort_block_size              64
+
+#define array__define_sort(name, type, less_expr)                              \
+static inline int name##_less(const type *a, const type *b) {                  \
+  return (less_expr);                                                          \
+}                                                                              \
+                                                                               \
+static inline void name##_swap(type *a, type *b) {                             \
+  type tmp = *a;                                                               \
+  *a = *b;                                                                     \
+  *b = tmp;                                                                    \
+}                                                                              \
+                                                                               \
+static inline void name##_sort2(type *a, type *b) {                            \
+  if (name##_less(b, a)) name##_swap(a, b);                                    \
+}                                                                              \
+                                                                               \
+static inline void name##_sort3(type *a, type *b, type *c) {                   \
+  name##_sort2(a, b);                                                          \
+  name##_sort2(b, c);                                                          \
+  name##_sort2(a, b);                                                          \
+}                                                                              \
+                                                                               \
+/* When guarded is 0, an item before begin must be <= every item in range. */  \
+static inline void name##_insertion_sort(type *begin, type *end,               \
+                                         int guarded) {                        \
+  if (begin == end) return;                                                    \
+  for (type *cur = begin + 1; cur != end; ++cur) {                             \
+    type *sift = cur;                                                          \
+    if (!name##_less(sift, sift - 1)) continue;                                \
+    type tmp = *sift;                                                          \
+    do {                                                                       \
+      *sift = *(sift - 1);                                                     \
+      --sift;                                                                  \
+    } while ((!guarded || sift != begin) && name##_less(&tmp, sift - 1));      \
+    *sift = tmp;                                                               \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+/* Gives up and returns 0 once more than a few items have moved. */            \
+static inline int name##_partial_insertion_sort(type *begin, type *end) {      \
+  if (begin == end) return 1;                                                  \
+  size_t limit = 0;                                                            \
+  for (type *cur = begin + 1; cur != end; ++cur) {                             \
+    type *sift = cur;                                                          \
+    if (!name##_less(sift, sift - 1)) continue;                                \
+    type tmp = *sift;                                                          \
+    do {                                                                       \
+      *sift = *(sift - 1);                                                     \
+      --sift;                                                                  \
+    } while (sift != begin && name##_less(&tmp, sift - 1));                    \
+    *sift = tmp;                                                               \
+    limit += cur - sift;                                                       \
+    if (limit > array__sort_partial_insertion_limit) return 0;                 \
+  }                                                                            \
+  return 1;                                                                    \
+}                                                                              \
+                                                                               \
+static inline void name##_sift_down(type *items, size_t root, size_t n) {      \
+  for (size_t child = 2 * root + 1; child < n; child = 2 * root + 1) {         \
+    if (child + 1 < n && name##_less(&items[child], &items[child + 1])) {      \
+      child++;                                                                 \
+    }                                                                          \
+    if (!name##_less(&items[root], &items[child])) return;                     \
+    name##_swap(&items[root], &items[child]);                                  \
+    root = child;                                                              \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_heap_sort(type *items, size_t n) {                   \
+  for (size_t i = n / 2; i-- > 0;) name##_sift_down(items, i, n);              \
+  for (size_t end = n; end-- > 1;) {                                           \
+    name##_swap(&items[0], &items[end]);                                       \
+    name##_sift_down(items, 0, end);                                           \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+/* Puts items equal to the pivot at *begin on the left; returns the pivot. */  \
+static inline type *name##_partition_left(type *begin, type *end) {            \
+  type pivot = *begin;                                                         \
+  type *first = begin, *last = end;                                            \
+  while (name##_less(&pivot, --last));                                         \
+  if (last + 1 == end) {                                                       \
+    while (first < last && !name##_less(&pivot, ++first));                     \
+  } else {                                                                     \
+    while (!name##_less(&pivot, ++first));                                     \
+  }                                                                            \
+  while (first < last) {                                                       \
+    name##_swap(first, last);                                                  \
+    while (name##_less(&pivot, --last));                                       \
+    while (!name##_less(&pivot, ++first));                                     \
+  }                                                                            \
+  *begin = *last;                                                              \
+  *last = pivot;                                                               \
+  return last;                                                                 \
+}                                                                              \
+                                                                               \
+/* Block partition around the pivot at *begin; equal items go right. The */    \
+/* comparisons only feed offsets and counters, so the data doesn't steer  */   \
+/* any branches. Sets *already_partitioned if no swaps were needed.       */   \
+static inline type *name##_partition_right(type *begin, type *end,             \
+                                           int *already_partitioned) {         \
+  type pivot = *begin;                                                         \
+  type *first = begin, *last = end;                                            \
+  while (name##_less(++first, &pivot));                                        \
+  if (first - 1 == begin) {                                                    \
+    while (first < last && !name##_less(--last, &pivot));                      \
+  } else {                                                                     \
+    while (!name##_less(--last, &pivot));                                      \
+  }                                                                            \
+  *already_partitioned = (first >= last);                                      \
+                                                                               \
+  if (!*already_partitioned) {                                                 \
+    name##_swap(first, last);                                                  \
+    ++first;                                                                   \
+                                                                               \
+    unsigned char offsets_l[array__sort_block_size];                           \
+    unsigned char offsets_r[array__sort_block_size];                           \
+    type *offsets_l_base = first, *offsets_r_base = last;                      \
+    size_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;                     \
+                                                                               \
+    while (first < last) {                                                     \
+      size_t num_unknown = last - first;                                       \
+      size_t left_split = num_l == 0 ?                                         \
+          (num_r == 0 ? num_unknown / 2 : num_unknown) : 0;                    \
+      size_t right_split = num_r == 0 ? (num_unknown - left_split) : 0;        \
+      if (left_split > array__sort_block_size) {                               \
+        left_split = array__sort_block_size;                                   \
+      }                                                                        \
+      if (right_split > array__sort_block_size) {                              \
+        right_split = array__sort_block_size;                                  \
+      }                                                                        \
+                                                                               \
+      for (size_t i = 0; i < left_split; ++i) {                                \
+        offsets_l[num_l] = (unsigned char)i;                                   \
+        num_l += !name##_less(first, &pivot);                                  \
+        ++first;                                                               \
+      }                                                                        \
+      for (size_t i = 0; i < right_split;) {                                   \
+        offsets_r[num_r] = (unsigned char)++i;                                 \
+        num_r += name##_less(--last, &pivot);                                  \
+      }                                                                        \
+                                                                               \
+      size_t num = num_l < num_r ? num_l : num_r;                              \
+      for (size_t i = 0; i < num; ++i) {                                       \
+        name##_swap(offsets_l_base + offsets_l[start_l + i],                   \
+                    offsets_r_base - offsets_r[start_r + i]);                  \
+      }                                                                        \
+      num_l -= num;                                                            \
+      num_r -= num;                                                            \
+      start_l += num;                                                          \
+      start_r += num;                                                          \
+      if (num_l == 0) {                                                        \
+        start_l = 0;                                                           \
+        offsets_l_base = first;                                                \
+      }                                                                        \
+      if (num_r == 0) {                                                        \
+        start_r = 0;                                                           \
+        offsets_r_base = last;                                                 \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    /* Move any leftover misplaced items across the boundary. */               \
+    if (num_l) {                                                               \
+      while (num_l--) {                                                        \
+        name##_swap(offsets_l_base + offsets_l[start_l + num_l], --last);      \
+      }                                                                        \
+      first = last;                                                            \
+    }                                                                          \
+    if (num_r) {                                                               \
+      while (num_r--) {                                                        \
+        name##_swap(offsets_r_base - offsets_r[start_r + num_r], first);       \
+        ++first;                                                               \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  type *pivot_pos = first - 1;                                                 \
+  *begin = *pivot_pos;                                                         \
+  *pivot_pos = pivot;                                                          \
+  return pivot_pos;                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_loop(type *begin, type *end, int bad_allowed,        \
+                               int leftmost) {                                 \
+  while (1) {                                                                  \
+    size_t size = end - begin;                                                 \
+    if (size < array__sort_insertion_threshold) {                              \
+      name##_insertion_sort(begin, end, leftmost);                             \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    /* Choose the pivot as the median of 3, or the pseudomedian of 9. */       \
+    size_t s2 = size / 2;                                                      \
+    if (size > array__sort_ninther_threshold) {                                \
+      name##_sort3(begin, begin + s2, end - 1);                                \
+      name##_sort3(begin + 1, begin + (s2 - 1), end - 2);                      \
+      name##_sort3(begin + 2, begin + (s2 + 1), end - 3);                      \
+      name##_sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1));            \
+      name##_swap(begin, begin + s2);                                          \
+    } else {                                                                   \
+      name##_sort3(begin + s2, begin, end - 1);                                \
+    }                                                                          \
+                                                                               \
+    /* If the pivot equals the item just before this range, which is no */     \
+    /* greater than anything in the range, then the pivot is the range's */    \
+    /* minimum. Group the items equal to it and skip past them.          */    \
+    if (!leftmost && !name##_less(begin - 1, begin)) {                         \
+      begin = name##_partition_left(begin, end) + 1;                           \
+      continue;                                                                \
+    }                                                                          \
+                                                                               \
+    int already_partitioned;                                                   \
+    type *pivot_pos = name##_partition_right(begin, end,                       \
+                                             &already_partitioned);            \
+    size_t l_size = pivot_pos - begin;                                         \
+    size_t r_size = end - (pivot_pos + 1);                                     \
+                                                                               \
+    if (l_size < size / 8 || r_size < size / 8) {                              \
+      /* After too many unbalanced partitions, heapsort guarantees n log n. */ \
+      if (--bad_allowed == 0) {                                                \
+        name##_heap_sort(begin, size);                                         \
+        return;                                                                \
+      }                                                                        \
+      /* Otherwise, swap a few items around to break up patterns. */           \
+      if (l_size >= array__sort_insertion_threshold) {                         \
+        name##_swap(begin, begin + l_size / 4);                                \
+        name##_swap(pivot_pos - 1, pivot_pos - l_size / 4);                    \
+        if (l_size > array__sort_ninther_threshold) {                          \
+          name##_swap(begin + 1, begin + (l_size / 4 + 1));                    \
+          name##_swap(begin + 2, begin + (l_size / 4 + 2));                    \
+          name##_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));            \
+          name##_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));            \
+        }                                                                      \
+      }                                                                        \
+      if (r_size >= array__sort_insertion_threshold) {                         \
+        name##_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));              \
+        name##_swap(end - 1, end - r_size / 4);                                \
+        if (r_size > array__sort_ninther_threshold) {                          \
+          name##_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));            \
+          name##_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));            \
+          name##_swap(end - 2, end - (1 + r_size / 4));                        \
+          name##_swap(end - 3, end - (2 + r_size / 4));                        \
+        }                                                                      \
+      }                                                                        \
+    } else if (already_partitioned &&                                          \
+               name##_partial_insertion_sort(begin, pivot_pos) &&              \
+               name##_partial_insertion_sort(pivot_pos + 1, end)) {            \
+      /* The input was likely already (nearly) sorted. */                      \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    name##_loop(begin, pivot_pos, bad_allowed, leftmost);                      \
+    begin = pivot_pos + 1;                                                     \
+    leftmost = 0;                                                              \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_items(type *items, size_t n) {                       \
+  int bad_allowed = 1;                                                         \
+  for (size_t m = n; m > 1; m >>= 1) bad_allowed++;                            \
+  name##_loop(items, items + n, bad_allowed, 1);                               \
+}                                                                              \
+                                                                               \
+static inline void name(Array array) {                                         \
+  name##_items((type *)array->items, array->count);                            \
+}
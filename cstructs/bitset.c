@@ -0,0 +1,261 @@
+// bitset.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// Bit i is bit i % 64 of word i / 64. The words Array holds exactly as many
+// words as num_bits needs, and every function that could set a bit past
+// num_bits clears the last word's tail afterwards.
+//
+
+#include "bitset.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define has_simd_bitsets
+#include <immintrin.h>
+#endif
+
+
+// Internal functions.
+// ===================
+
+static size_t num_words(size_t num_bits) {
+  return num_bits / 64 + (num_bits % 64 != 0);
+}
+
+// Zeroes the bits of the last word that are past num_bits.
+static void clear_tail(Bitset bitset) {
+  size_t used = bitset->num_bits % 64;
+  if (used == 0) return;
+  uint64_t *last = bitset__words(bitset) + bitset->words.count - 1;
+  *last &= ((uint64_t)1 << used) - 1;
+}
+
+static int lowest_bit(uint64_t word) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(word);
+#else
+  int i = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+static size_t popcount(uint64_t word) {
+#if defined(__GNUC__)
+  return (size_t)__builtin_popcountll(word);
+#else
+  word = word - ((word >> 1) & 0x5555555555555555ull);
+  word = (word & 0x3333333333333333ull) +
+         ((word >> 2) & 0x3333333333333333ull);
+  word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return (size_t)((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+typedef void   (*BulkFunction)  (uint64_t *dst, const uint64_t *src, size_t n);
+typedef size_t (*CountFunction) (const uint64_t *words, size_t n);
+
+static void and_scalar(uint64_t *dst, const uint64_t *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] &= src[i];
+}
+
+static void or_scalar(uint64_t *dst, const uint64_t *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] |= src[i];
+}
+
+static void andnot_scalar(uint64_t *dst, const uint64_t *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] &= ~src[i];
+}
+
+static size_t count_scalar(const uint64_t *words, size_t n) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) count += popcount(words[i]);
+  return count;
+}
+
+#ifdef has_simd_bitsets
+
+// Each handles 256 bits per step, and finishes the last few words one at a
+// time.
+#define define_bulk_avx2(name, vector_op, scalar_op)                     \
+  static __attribute__((target("avx2")))                                \
+  void name##_avx2(uint64_t *dst, const uint64_t *src, size_t n) {      \
+    size_t i = 0;                                                       \
+    for (; i + 4 <= n; i += 4) {                                        \
+      __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));       \
+      __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));       \
+      _mm256_storeu_si256((__m256i *)(dst + i), vector_op);             \
+    }                                                                   \
+    for (; i < n; ++i) dst[i] scalar_op;                                \
+  }
+
+define_bulk_avx2(and,    _mm256_and_si256(d, s),    &= src[i])
+define_bulk_avx2(or,     _mm256_or_si256(d, s),     |= src[i])
+define_bulk_avx2(andnot, _mm256_andnot_si256(s, d), &= ~src[i])
+
+static __attribute__((target("popcnt")))
+size_t count_popcnt(const uint64_t *words, size_t n) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) count += __builtin_popcountll(words[i]);
+  return count;
+}
+
+// Counts each nibble's bits with a 16-entry table lookup, as in Mula, Kurz
+// and Lemire's "Faster population counts", and sums the byte counts into
+// 64-bit lanes.
+static __attribute__((target("avx2,popcnt")))
+size_t count_avx2(const uint64_t *words, size_t n) {
+  const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  __m256i totals = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v  = _mm256_loadu_si256((const __m256i *)(words + i));
+    __m256i lo = _mm256_and_si256(v, low_nibbles);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+    __m256i byte_counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, lo),
+                                          _mm256_shuffle_epi8(table, hi));
+    totals = _mm256_add_epi64(totals, _mm256_sad_epu8(byte_counts,
+                                                      _mm256_setzero_si256()));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, totals);
+  size_t count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  for (; i < n; ++i) count += __builtin_popcountll(words[i]);
+  return count;
+}
+
+#endif  // has_simd_bitsets
+
+static int has_avx2() {
+#ifdef has_simd_bitsets
+  return __builtin_cpu_supports("avx2");
+#else
+  return 0;
+#endif
+}
+
+static void run_bulk(Bitset dst, Bitset src, BulkFunction scalar,
+                     BulkFunction avx2) {
+  size_t n = dst->words.count < src->words.count ? dst->words.count
+                                                 : src->words.count;
+  BulkFunction bulk = (avx2 && has_avx2()) ? avx2 : scalar;
+  bulk(bitset__words(dst), bitset__words(src), n);
+}
+
+#ifdef has_simd_bitsets
+#define avx2_version(name) name##_avx2
+#else
+#define avx2_version(name) NULL
+#endif
+
+
+// Public functions.
+// =================
+
+Bitset bitset__new(size_t num_bits) {
+  Bitset bitset = malloc(sizeof(BitsetStruct));
+  if (bitset == NULL) return NULL;
+  if (bitset__init(bitset, num_bits) == NULL) {
+    free(bitset);
+    return NULL;
+  }
+  return bitset;
+}
+
+Bitset bitset__init(Bitset bitset, size_t num_bits) {
+  size_t n = num_words(num_bits);
+  if (array__init(&bitset->words, n, sizeof(uint64_t)) == NULL) return NULL;
+  if (array__add_zeroed_items(&bitset->words, n) == NULL) {
+    array__release(&bitset->words);
+    return NULL;
+  }
+  bitset->num_bits = num_bits;
+  return bitset;
+}
+
+void bitset__release(void *bitset) {
+  Bitset b = (Bitset)bitset;
+  array__release(&b->words);
+  b->num_bits = 0;
+}
+
+void bitset__release_with_context(void *bitset, void *context) {
+  bitset__release(bitset);
+}
+
+void bitset__delete(Bitset bitset) {
+  bitset__release(bitset);
+  free(bitset);
+}
+
+int bitset__resize(Bitset bitset, size_t num_bits) {
+  size_t old_n = bitset->words.count, n = num_words(num_bits);
+  if (n > old_n &&
+      array__add_zeroed_items(&bitset->words, n - old_n) == NULL) {
+    return 0;
+  }
+  bitset->words.count = n;
+  bitset->num_bits    = num_bits;
+  clear_tail(bitset);
+  return 1;
+}
+
+void bitset__clear(Bitset bitset) {
+  memset(bitset->words.items, 0, bitset->words.count * sizeof(uint64_t));
+}
+
+void bitset__set_all(Bitset bitset) {
+  memset(bitset->words.items, 0xff, bitset->words.count * sizeof(uint64_t));
+  clear_tail(bitset);
+}
+
+size_t bitset__count(Bitset bitset) {
+  CountFunction count = count_scalar;
+#ifdef has_simd_bitsets
+  if (__builtin_cpu_supports("avx2")) {
+    count = count_avx2;
+  } else if (__builtin_cpu_supports("popcnt")) {
+    count = count_popcnt;
+  }
+#endif
+  return count(bitset__words(bitset), bitset->words.count);
+}
+
+void bitset__and(Bitset dst, Bitset src) {
+  run_bulk(dst, src, and_scalar, avx2_version(and));
+}
+
+void bitset__or(Bitset dst, Bitset src) {
+  run_bulk(dst, src, or_scalar, avx2_version(or));
+  clear_tail(dst);
+}
+
+void bitset__andnot(Bitset dst, Bitset src) {
+  run_bulk(dst, src, andnot_scalar, avx2_version(andnot));
+}
+
+size_t bitset__next_set(Bitset bitset, size_t from) {
+  if (from >= bitset->num_bits) return bitset->num_bits;
+  const uint64_t *words = bitset__words(bitset);
+  size_t w = from / 64;
+  uint64_t word = words[w] & (~(uint64_t)0 << (from % 64));
+  while (word == 0) {
+    if (++w == bitset->words.count) return bitset->num_bits;
+    word = words[w];
+  }
+  return w * 64 + lowest_bit(word);
+}
@@ -0,0 +1,78 @@
+// bitset.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A fixed-size set of bits, packed 64 to a word, for membership flags that
+// would otherwise take a byte each.
+//
+// The words live in an Array, so large bitsets move into a memory mapping
+// just as large arrays do. Bits past num_bits in the last word are always 0,
+// which lets the bulk operations work a whole word at a time. Counting uses
+// the hardware popcount instruction, and the bulk operations use AVX2 when
+// the CPU supports it.
+//
+// As with Array, a bitset may be nested in another structure: bitset__init
+// sets up a BitsetStruct whose memory is already allocated, and
+// bitset__release frees what it points to. bitset__release_with_context has
+// the Releaser signature, so it can be the releaser of an Array of
+// BitsetStructs.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+  size_t      num_bits;
+  ArrayStruct words;     // words.count is the number of 64-bit words.
+} BitsetStruct;
+
+typedef BitsetStruct *Bitset;
+
+// These return NULL if the memory can't be allocated. All bits start as 0.
+Bitset bitset__new     (size_t num_bits);
+Bitset bitset__init    (Bitset bitset, size_t num_bits);
+void   bitset__release (void *bitset);  // Frees the words but not bitset.
+void   bitset__delete  (Bitset bitset);
+
+void   bitset__release_with_context(void *bitset, void *context);
+
+// Changes the number of bits; bits that are added start as 0. Returns 0, and
+// leaves the bitset unchanged, if the memory can't be allocated.
+int    bitset__resize  (Bitset bitset, size_t num_bits);
+
+// Single-bit operations; i must be below num_bits, and is evaluated twice.
+#define bitset__words(b) ((uint64_t *)(b)->words.items)
+#define bitset__test(b, i) \
+  ((int)((bitset__words(b)[(i) >> 6] >> ((i) & 63)) & 1))
+#define bitset__set(b, i) \
+  (bitset__words(b)[(i) >> 6] |= (uint64_t)1 << ((i) & 63))
+#define bitset__unset(b, i) \
+  (bitset__words(b)[(i) >> 6] &= ~((uint64_t)1 << ((i) & 63)))
+
+void   bitset__clear   (Bitset bitset);  // Sets every bit to 0.
+void   bitset__set_all (Bitset bitset);  // Sets every bit to 1.
+
+// The number of bits that are 1.
+size_t bitset__count   (Bitset bitset);
+
+// These update dst in place: dst &= src, dst |= src, and dst &= ~src. They
+// expect both bitsets to have the same number of bits.
+void   bitset__and     (Bitset dst, Bitset src);
+void   bitset__or      (Bitset dst, Bitset src);
+void   bitset__andnot  (Bitset dst, Bitset src);
+
+// Returns the index of the first 1 bit at or after index from, or num_bits if
+// there's none.
+size_t bitset__next_set(Bitset bitset, size_t from);
+
+// Loop over the indexes of the 1 bits in increasing order.
+// Example: bitset__for_set(bitset, i) { /* loop body */ }
+// The body may change bits; changes past i are seen by the loop.
+#define bitset__for_set(bitset, index)                          \
+  for (size_t index = bitset__next_set(bitset, 0);              \
+       index < (bitset)->num_bits;                              \
+       index = bitset__next_set(bitset, index + 1))
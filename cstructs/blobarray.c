@@ -0,0 +1,299 @@
+// blobarray.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// Item i is bytes[offsets[i] .. offsets[i + 1] - 1), and bytes[offsets[i + 1]
+// - 1] is its 0 terminator. The offsets array always holds count + 1 entries,
+// so an empty blob array still has its leading 0 offset.
+//
+
+#include "blobarray.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+
+// Internal functions.
+// ===================
+
+// The header that blobarray__save writes before the offsets and bytes. It's
+// padded to 64 bytes, as array__save's is.
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t byte_order;  // file_byte_order, as written by the saving machine.
+  uint64_t count;
+  uint64_t num_bytes;
+  char     padding[32];
+} FileHeader;
+
+static const char file_magic[8] = "cstblobs";
+#define file_version    1
+#define file_byte_order 0x01020304u
+
+#define offsets_of(blobs) ((uint64_t *)(blobs)->offsets.items)
+
+// The permutation that sorting works on. The prefix holds an item's first 8
+// bytes, big-endian and padded with zeros, so that comparing prefixes as
+// integers agrees with byte order for most pairs of items without a memcmp.
+typedef struct {
+  uint64_t prefix;
+  size_t   index;
+} SortEntry;
+
+typedef struct {
+  BlobArray                  blobs;
+  blobarray__CompareFunction compare;
+  void *                     compare_context;
+} SortContext;
+
+static uint64_t prefix_of(const unsigned char *item, size_t len) {
+  uint64_t prefix = 0;
+  for (size_t i = 0; i < 8; ++i) prefix = prefix << 8 | (i < len ? item[i] : 0);
+  return prefix;
+}
+
+static int compare_bytes(const void *a, size_t a_len,
+                         const void *b, size_t b_len) {
+  int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if (c) return c;
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+static int compare_entries(void *context, const void *a, const void *b) {
+  SortContext *ctx = (SortContext *)context;
+  const SortEntry *x = (const SortEntry *)a, *y = (const SortEntry *)b;
+  if (ctx->compare == NULL && x->prefix != y->prefix) {
+    return x->prefix < y->prefix ? -1 : 1;
+  }
+  size_t x_len, y_len;
+  void *x_item = blobarray__get(ctx->blobs, x->index, &x_len);
+  void *y_item = blobarray__get(ctx->blobs, y->index, &y_len);
+  int c = ctx->compare ? ctx->compare(ctx->compare_context, x_item, x_len,
+                                      y_item, y_len)
+                       : compare_bytes(x_item, x_len, y_item, y_len);
+  if (c) return c;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+// Returns a new array of the sorted permutation, or NULL if the memory can't
+// be allocated.
+static Array sorted_entries(BlobArray blobs,
+                            blobarray__CompareFunction compare,
+                            void *compare_context) {
+  size_t n = blobarray__count(blobs);
+  Array entries = array__new(n, sizeof(SortEntry));
+  if (entries == NULL) return NULL;
+  for (size_t i = 0; i < n; ++i) {
+    SortEntry *entry = array__new_ptr(entries);
+    size_t len;
+    void *item    = blobarray__get(blobs, i, &len);
+    entry->prefix = compare ? 0 : prefix_of(item, len);
+    entry->index  = i;
+  }
+  SortContext context = {blobs, compare, compare_context};
+  array__sort(entries, compare_entries, &context);
+  return entries;
+}
+
+static int init_arrays(BlobArray blobs, size_t count, size_t num_bytes) {
+  if (array__init(&blobs->bytes, num_bytes, 1) == NULL) return 0;
+  if (array__init(&blobs->offsets, count + 1, sizeof(uint64_t)) == NULL) {
+    array__release(&blobs->bytes);
+    return 0;
+  }
+  return 1;
+}
+
+
+// Public functions.
+// =================
+
+BlobArray blobarray__new() {
+  BlobArray blobs = malloc(sizeof(BlobArrayStruct));
+  if (blobs == NULL) return NULL;
+  if (blobarray__init(blobs) == NULL) {
+    free(blobs);
+    return NULL;
+  }
+  return blobs;
+}
+
+BlobArray blobarray__init(BlobArray blobs) {
+  if (!init_arrays(blobs, 0, 0)) return NULL;
+  uint64_t zero = 0;
+  array__add_item_val(&blobs->offsets, zero);
+  return blobs;
+}
+
+void blobarray__release(void *blobs) {
+  BlobArray b = (BlobArray)blobs;
+  array__release(&b->bytes);
+  array__release(&b->offsets);
+}
+
+void blobarray__release_with_context(void *blobs, void *context) {
+  blobarray__release(blobs);
+}
+
+void blobarray__delete(BlobArray blobs) {
+  blobarray__release(blobs);
+  free(blobs);
+}
+
+void blobarray__clear(BlobArray blobs) {
+  blobs->bytes.count   = 0;
+  blobs->offsets.count = 1;
+}
+
+void *blobarray__add(BlobArray blobs, const void *item, size_t len) {
+  size_t start = blobs->bytes.count;
+  if (len > SIZE_MAX - 1 - start) return NULL;
+  uint64_t end = start + len + 1;
+  if (array__add_item_ptr(&blobs->offsets, &end) == NULL) return NULL;
+  if ((len && array__append_items(&blobs->bytes, item, len) == NULL) ||
+      array__add_zeroed_items(&blobs->bytes, 1) == NULL) {
+    blobs->bytes.count = start;
+    blobs->offsets.count--;
+    return NULL;
+  }
+  return blobs->bytes.items + start;
+}
+
+void *blobarray__get(BlobArray blobs, size_t index, size_t *len) {
+  uint64_t *offsets = offsets_of(blobs);
+  if (len) *len = offsets[index + 1] - offsets[index] - 1;
+  return blobs->bytes.items + offsets[index];
+}
+
+int blobarray__sort_order(BlobArray blobs, Array order,
+                          blobarray__CompareFunction compare,
+                          void *compare_context) {
+  size_t n = blobarray__count(blobs);
+  if (n > SIZE_MAX - order->count ||
+      !array__reserve(order, order->count + n)) {
+    return 0;
+  }
+  Array entries = sorted_entries(blobs, compare, compare_context);
+  if (entries == NULL) return 0;
+  array__for(SortEntry *, entry, entries, i) {
+    array__add_item_ptr(order, &entry->index);
+  }
+  array__delete(entries);
+  return 1;
+}
+
+int blobarray__sort(BlobArray blobs,
+                    blobarray__CompareFunction compare,
+                    void *compare_context) {
+  size_t n = blobarray__count(blobs);
+  Array entries = sorted_entries(blobs, compare, compare_context);
+  BlobArrayStruct sorted;
+  if (entries == NULL || !init_arrays(&sorted, n, blobs->bytes.count)) {
+    if (entries) array__delete(entries);
+    return 0;
+  }
+  sorted.bytes.growth_factor   = blobs->bytes.growth_factor;
+  sorted.offsets.growth_factor = blobs->offsets.growth_factor;
+
+  uint64_t *offsets     = offsets_of(blobs);
+  uint64_t *new_offsets = offsets_of(&sorted);
+  uint64_t  at          = 0;
+  new_offsets[0] = 0;
+  for (size_t i = 0; i < n; ++i) {
+    size_t index = array__item_val(entries, i, SortEntry).index;
+    size_t size  = offsets[index + 1] - offsets[index];
+    memcpy(sorted.bytes.items + at, blobs->bytes.items + offsets[index], size);
+    at += size;
+    new_offsets[i + 1] = at;
+  }
+  sorted.bytes.count   = at;
+  sorted.offsets.count = n + 1;
+
+  array__delete(entries);
+  blobarray__release(blobs);
+  *blobs = sorted;
+  return 1;
+}
+
+int blobarray__save(BlobArray blobs, const char *path) {
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, file_magic, sizeof(header.magic));
+  header.version    = file_version;
+  header.byte_order = file_byte_order;
+  header.count      = blobarray__count(blobs);
+  header.num_bytes  = blobs->bytes.count;
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) return 0;
+  size_t num_offsets = blobs->offsets.count;
+  int did_write =
+      fwrite(&header, sizeof(header), 1, f) == 1 &&
+      fwrite(blobs->offsets.items, sizeof(uint64_t), num_offsets, f) ==
+          num_offsets &&
+      fwrite(blobs->bytes.items, 1, blobs->bytes.count, f) ==
+          blobs->bytes.count;
+  return (fclose(f) == 0) && did_write;
+}
+
+BlobArray blobarray__load(const char *path) {
+  FileHeader header;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return NULL;
+  int is_valid = fread(&header, sizeof(header), 1, f) == 1 &&
+                 memcmp(header.magic, file_magic, sizeof(header.magic)) == 0 &&
+                 header.version    == file_version    &&
+                 header.byte_order == file_byte_order &&
+                 header.count      <  SIZE_MAX / sizeof(uint64_t) - 1 &&
+                 header.num_bytes  <= SIZE_MAX;
+  size_t num_offsets = is_valid ? header.count + 1 : 0;
+#ifndef _WIN32
+  struct stat st;
+  is_valid = is_valid && fstat(fileno(f), &st) == 0 &&
+             (uint64_t)st.st_size == sizeof(header) +
+                                     num_offsets * sizeof(uint64_t) +
+                                     header.num_bytes;
+#endif
+  BlobArray blobs = is_valid ? malloc(sizeof(BlobArrayStruct)) : NULL;
+  if (blobs && !init_arrays(blobs, header.count, header.num_bytes)) {
+    free(blobs);
+    blobs = NULL;
+  }
+  if (blobs == NULL) {
+    fclose(f);
+    return NULL;
+  }
+
+  is_valid = fread(blobs->offsets.items, sizeof(uint64_t), num_offsets, f) ==
+                 num_offsets &&
+             fread(blobs->bytes.items, 1, header.num_bytes, f) ==
+                 header.num_bytes;
+  fclose(f);
+  blobs->offsets.count = num_offsets;
+  blobs->bytes.count   = header.num_bytes;
+
+  // Check that the offsets rise, end at the last byte, and that every item
+  // has its 0 terminator, so that blobarray__get is safe on every index.
+  uint64_t *offsets = offsets_of(blobs);
+  is_valid = is_valid && offsets[0] == 0 &&
+             offsets[header.count] == header.num_bytes;
+  for (size_t i = 0; is_valid && i < header.count; ++i) {
+    is_valid = offsets[i] < offsets[i + 1] &&
+               offsets[i + 1] <= header.num_bytes &&
+               blobs->bytes.items[offsets[i + 1] - 1] == 0;
+  }
+  if (!is_valid) {
+    blobarray__delete(blobs);
+    return NULL;
+  }
+  return blobs;
+}
@@ -0,0 +1,92 @@
+// blobarray.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A sequence of variable-length items, such as strings, stored back to back
+// in one byte buffer. An Array of char * with a free releaser makes one
+// allocation per string, scattered over the heap; a BlobArray makes two in
+// all, one for the bytes and one for the offsets, and frees them together.
+//
+// Each item is followed by a 0 byte that isn't counted in its length, so an
+// item added from a C string can be used as a C string. Items are found in
+// O(1) time through the offsets. Pointers to items are invalidated when the
+// blob array grows, just as pointers to Array items are.
+//
+// As with Array, a blob array may be nested in another structure:
+// blobarray__init sets up a BlobArrayStruct whose memory is already
+// allocated, and blobarray__release frees what it points to.
+// blobarray__release_with_context has the Releaser signature, so it can be
+// the releaser of an Array of BlobArrayStructs.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  ArrayStruct bytes;    // Every item, each followed by a 0 byte.
+  ArrayStruct offsets;  // count + 1 uint64_t offsets into bytes, from 0.
+} BlobArrayStruct;
+
+typedef BlobArrayStruct *BlobArray;
+
+// Compares two items; returns <0, 0, or >0 as a is before, equal to, or after
+// b, just as an array__CompareFunction does.
+typedef int (*blobarray__CompareFunction)(void *context,
+                                          const void *a, size_t a_len,
+                                          const void *b, size_t b_len);
+
+// These return NULL if the memory can't be allocated.
+BlobArray blobarray__new     ();
+BlobArray blobarray__init    (BlobArray blobs);
+void      blobarray__release (void *blobs);  // Frees all mem but blobs itself.
+void      blobarray__delete  (BlobArray blobs);
+void      blobarray__clear   (BlobArray blobs);  // Sets the count to 0.
+
+void      blobarray__release_with_context(void *blobs, void *context);
+
+#define blobarray__count(blobs) ((blobs)->offsets.count - 1)
+
+// Copies len bytes from item to the end of the blob array, and returns a
+// pointer to the copy. item may point into the blob array itself. Returns
+// NULL, leaving the blob array unchanged, if the memory can't be allocated.
+void *    blobarray__add     (BlobArray blobs, const void *item, size_t len);
+#define   blobarray__add_str(blobs, str) \
+  ((char *)blobarray__add(blobs, str, strlen(str)))
+
+// Returns a pointer to item index, and sets *len to its length unless len is
+// NULL.
+void *    blobarray__get     (BlobArray blobs, size_t index, size_t *len);
+
+// Sorting. A NULL compare means byte order, with a shorter item before a
+// longer one that starts with it, which is strcmp order for strings. Items
+// that compare equal keep their order. Both functions sort an index
+// permutation rather than the items; byte order compares an 8-byte prefix of
+// each item stored in the permutation before it looks at the items.
+
+// Appends to order, whose item size must be sizeof(size_t), the indexes of
+// the items in sorted order, leaving the blob array unchanged. Returns 0,
+// leaving order unchanged, if the memory can't be allocated.
+int       blobarray__sort_order(BlobArray blobs, Array order,
+                                blobarray__CompareFunction compare,
+                                void *compare_context);
+
+// Sorts the items, rewriting the bytes in order with one pass of copies.
+// Returns 0, leaving the blob array unchanged, if the memory can't be
+// allocated.
+int       blobarray__sort    (BlobArray blobs,
+                              blobarray__CompareFunction compare,
+                              void *compare_context);
+
+// Writes a small header, the offsets, and the bytes to the file at path,
+// replacing it if it exists. Returns 1 on success and 0 on failure.
+int       blobarray__save    (BlobArray blobs, const char *path);
+
+// Reads a file written by blobarray__save into a new blob array. Returns NULL
+// if the file can't be read, isn't a blob array file, was written with a
+// different byte order, or is damaged.
+BlobArray blobarray__load    (const char *path);
@@ -0,0 +1,105 @@
+// colarray.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "colarray.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <string.h>
+
+
+// Internal functions.
+// ===================
+
+// Grows every column by num_rows zeroed items, or, if any column can't grow,
+// puts back the counts of the columns already grown and returns 0.
+static int grow_columns(ColArray col_array, size_t num_rows) {
+  for (int c = 0; c < col_array->num_columns; ++c) {
+    if (array__add_zeroed_items(&col_array->columns[c], num_rows) == NULL) {
+      while (c-- > 0) col_array->columns[c].count = col_array->count;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+// Public functions.
+// =================
+
+ColArray colarray__new(int num_columns, const size_t *column_sizes) {
+  ColArray col_array = malloc(sizeof(ColArrayStruct));
+  if (col_array == NULL) return NULL;
+  col_array->count       = 0;
+  col_array->num_columns = 0;
+  col_array->columns     = malloc(num_columns * sizeof(ArrayStruct));
+  if (col_array->columns == NULL) {
+    free(col_array);
+    return NULL;
+  }
+  for (int c = 0; c < num_columns; ++c) {
+    if (array__init(&col_array->columns[c], 1, column_sizes[c]) == NULL) {
+      colarray__delete(col_array);
+      return NULL;
+    }
+    col_array->num_columns++;
+  }
+  return col_array;
+}
+
+void colarray__delete(ColArray col_array) {
+  for (int c = 0; c < col_array->num_columns; ++c) {
+    array__release(&col_array->columns[c]);
+  }
+  free(col_array->columns);
+  free(col_array);
+}
+
+void colarray__clear(ColArray col_array) {
+  for (int c = 0; c < col_array->num_columns; ++c) {
+    array__clear(&col_array->columns[c]);
+  }
+  col_array->count = 0;
+}
+
+void *colarray__column_ptr(ColArray col_array, int column) {
+  return col_array->columns[column].items;
+}
+
+void *colarray__item_ptr(ColArray col_array, int column, size_t row) {
+  return array__item_ptr(&col_array->columns[column], row);
+}
+
+int colarray__add_row(ColArray col_array, void **fields) {
+  if (!grow_columns(col_array, 1)) return 0;
+  for (int c = 0; c < col_array->num_columns; ++c) {
+    if (fields[c] == NULL) continue;
+    Array column = &col_array->columns[c];
+    memcpy(array__item_ptr(column, col_array->count), fields[c],
+           column->item_size);
+  }
+  col_array->count++;
+  return 1;
+}
+
+int colarray__add_zeroed_rows(ColArray col_array, size_t num_rows) {
+  if (!grow_columns(col_array, num_rows)) return 0;
+  col_array->count += num_rows;
+  return 1;
+}
+
+int colarray__reserve(ColArray col_array, size_t capacity) {
+  if (capacity <= col_array->count) return 1;
+  // array__reserve only allocates, so pages past the rows stay untouched.
+  for (int c = 0; c < col_array->num_columns; ++c) {
+    if (!array__reserve(&col_array->columns[c], capacity)) {
+      while (c-- > 0) array__shrink_to_fit(&col_array->columns[c]);
+      return 0;
+    }
+  }
+  return 1;
+}
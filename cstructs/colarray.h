@@ -0,0 +1,83 @@
+// colarray.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A columnar (struct-of-arrays) counterpart to Array.
+//
+// An Array of records keeps each record's fields next to each other, so a
+// loop over one field still pulls every other field through the cache. A
+// ColArray keeps each field in its own column, and every column is an Array
+// with the same count. A scan over one column reads only that column's
+// bytes, and the column can be handed to any array__ function, such as
+// array__count_equal or array__sort_by_key.
+//
+// Columns grow together: adding rows either succeeds in every column or
+// leaves every column as it was. Sorting or otherwise reordering a single
+// column breaks its alignment with the other columns.
+//
+// Example:
+//
+//   size_t sizes[] = {sizeof(int), sizeof(double)};  // Columns: id, price.
+//   ColArray orders = colarray__new(2, sizes);
+//
+//   int id = 7;
+//   double price = 9.5;
+//   void *fields[] = {&id, &price};
+//   colarray__add_row(orders, fields);
+//
+//   double total = 0;
+//   colarray__for(double *, price_ptr, orders, 1, row) total += *price_ptr;
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdlib.h>
+
+typedef struct {
+  size_t        count;        // The number of rows, and each column's count.
+  int           num_columns;
+  ArrayStruct * columns;      // columns[c] holds field c of every row.
+} ColArrayStruct;
+
+typedef ColArrayStruct *ColArray;
+
+// Returns NULL if the memory can't be allocated. Column c's items are
+// column_sizes[c] bytes each.
+ColArray colarray__new    (int num_columns, const size_t *column_sizes);
+void     colarray__delete (ColArray col_array);
+
+// Releases the items of every column, using column releasers if set, and
+// sets the row count to zero.
+void     colarray__clear  (ColArray col_array);
+
+// Column c's Array; it's fine to set its releaser, read it, and write its
+// items, but changing its count directly would misalign the columns.
+#define  colarray__column(col_array, c) (&(col_array)->columns[c])
+
+// A pointer to the first item of column c; the items are contiguous.
+void *   colarray__column_ptr (ColArray col_array, int column);
+void *   colarray__item_ptr   (ColArray col_array, int column, size_t row);
+#define  colarray__item_val(col_array, column, row, type) \
+  (*(type *)colarray__item_ptr(col_array, column, row))
+
+// Adds a row whose field c is copied from fields[c]; a NULL fields[c] adds a
+// zeroed field. Returns 1 on success and 0 if any column couldn't grow, in
+// which case no column changes.
+int      colarray__add_row          (ColArray col_array, void **fields);
+
+// Adds num_rows all-zero rows. Returns 1 on success and 0 on failure, in which
+// case no column changes.
+int      colarray__add_zeroed_rows  (ColArray col_array, size_t num_rows);
+
+// Reserves room for at least capacity rows in every column, so that adding
+// up to that many rows can't fail. Returns 1 on success and 0 on failure;
+// on failure the rows are unchanged, and columns that had already grown give
+// back their unused capacity.
+int      colarray__reserve          (ColArray col_array, size_t capacity);
+
+// Loops over one column, the same way array__for loops over an Array.
+// Example: colarray__for(double *, price, orders, 1, row) { /* loop body */ }
+#define colarray__for(type, item_ptr, col_array, column, index) \
+  array__for(type, item_ptr, colarray__column(col_array, column), index)
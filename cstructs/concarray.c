@@ -0,0 +1,159 @@
+// concarray.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// Segments are laid out as in SegArray: segment k holds 2 ^ (first_bits + k)
+// items. Each segment is one allocation holding its items followed by one
+// ready flag byte per item. Segments are allocated zeroed, so every flag
+// starts out clear.
+//
+
+#include "concarray.h"
+
+#include "internal.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define load(ptr)                 (*(ptr))
+#define store(ptr, val)           (*(ptr) = (val))
+#define fetch_add(ptr, val)       ((*(ptr) += (val)) - (val))
+#define compare_swap(ptr, expected, desired)                          \
+  (*(ptr) == *(expected) ? (*(ptr) = (desired), 1)                    \
+                         : (*(expected) = *(ptr), 0))
+#define full_fence()              ((void)0)
+#else
+// Loads acquire and stores release; a thread that sees a ready flag or a
+// segment pointer also sees the writes made before it was stored.
+#define load(ptr)                 __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define store(ptr, val)           __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define fetch_add(ptr, val)       \
+  __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST)
+#define compare_swap(ptr, expected, desired)                          \
+  __atomic_compare_exchange_n(ptr, expected, desired, 0,              \
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define full_fence()              __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+
+// Internal functions.
+// ===================
+
+static size_t segment_size(ConcArray conc_array, int k) {
+  return (size_t)1 << (conc_array->first_bits + k);
+}
+
+// Returns segment k, allocating it if no other thread has yet, or returns
+// NULL if it can't be allocated.
+static char *get_segment(ConcArray conc_array, int k) {
+  if (k >= concarray__max_segments ||
+      conc_array->first_bits + k >= 64) return NULL;
+  char *segment = load(&conc_array->segments[k]);
+  if (segment) return segment;
+  size_t num_items = segment_size(conc_array, k);
+  if (num_items > SIZE_MAX / (conc_array->item_size + 1)) return NULL;
+  char *new_segment = calloc(num_items, conc_array->item_size + 1);
+  if (new_segment == NULL) return NULL;
+  if (compare_swap(&conc_array->segments[k], &segment, new_segment)) {
+    return new_segment;
+  }
+  // Another thread installed this segment first; segment now holds it.
+  free(new_segment);
+  return segment;
+}
+
+static unsigned char *ready_flag(ConcArray conc_array, char *segment, int k,
+                                 size_t offset) {
+  size_t num_items = segment_size(conc_array, k);
+  return (unsigned char *)segment + num_items * conc_array->item_size +
+         offset;
+}
+
+static int is_ready(ConcArray conc_array, size_t index) {
+  size_t offset;
+  int k = segment_of(conc_array->first_bits, index, &offset);
+  char *segment = load(&conc_array->segments[k]);
+  return segment && load(ready_flag(conc_array, segment, k, offset));
+}
+
+// Moves the count past every ready slot that follows it. Called after this
+// thread stores its ready flags.
+static void advance_count(ConcArray conc_array) {
+  // Release stores may be reordered after the acquire loads below, so
+  // without this fence two appenders could each miss the other's flags,
+  // and neither would move the count past the other's slots.
+  full_fence();
+  size_t count = load(&conc_array->count);
+  while (1) {
+    size_t end = count, reserved = load(&conc_array->reserved);
+    while (end < reserved && is_ready(conc_array, end)) ++end;
+    if (end == count) return;
+    // On failure, count is updated to the latest value and we rescan.
+    if (compare_swap(&conc_array->count, &count, end)) count = end;
+  }
+}
+
+
+// Public functions.
+// =================
+
+ConcArray concarray__new(size_t first_capacity, size_t item_size) {
+  ConcArray conc_array = calloc(1, sizeof(ConcArrayStruct));
+  if (conc_array == NULL) return NULL;
+  conc_array->item_size = item_size;
+  while (conc_array->first_bits < 62 &&
+         ((size_t)1 << conc_array->first_bits) < first_capacity) {
+    conc_array->first_bits++;
+  }
+  return conc_array;
+}
+
+void concarray__delete(ConcArray conc_array) {
+  for (int k = 0; k < concarray__max_segments; ++k) {
+    free(conc_array->segments[k]);
+  }
+  free(conc_array);
+}
+
+size_t concarray__append(ConcArray conc_array, const void *items,
+                         size_t num_items) {
+  if (num_items == 0) return load(&conc_array->reserved);
+  size_t size = conc_array->item_size;
+  size_t first = fetch_add(&conc_array->reserved, num_items);
+  const char *src = (const char *)items;
+
+  // Copy the items one segment's worth at a time.
+  size_t index = first, end = first + num_items;
+  while (index < end) {
+    size_t offset;
+    int k = segment_of(conc_array->first_bits, index, &offset);
+    char *segment = get_segment(conc_array, k);
+    if (segment == NULL) return SIZE_MAX;
+    size_t n = segment_size(conc_array, k) - offset;
+    if (n > end - index) n = end - index;
+    memcpy(segment + offset * size, src, n * size);
+    unsigned char *flags = ready_flag(conc_array, segment, k, offset);
+    for (size_t i = 0; i < n; ++i) store(&flags[i], 1);
+    src   += n * size;
+    index += n;
+  }
+
+  advance_count(conc_array);
+  return first;
+}
+
+size_t concarray__count(ConcArray conc_array) {
+  return load(&conc_array->count);
+}
+
+void *concarray__item_ptr(ConcArray conc_array, size_t index) {
+  size_t offset;
+  int k = segment_of(conc_array->first_bits, index, &offset);
+  return load(&conc_array->segments[k]) + offset * conc_array->item_size;
+}
@@ -0,0 +1,60 @@
+// concarray.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// An append-only array that many threads can add to at once without locks.
+//
+// An append reserves its slots with one atomic fetch-add on the reserved
+// count, then copies its items in. Items live in segments that double in
+// size, as in SegArray; when an append's slots fall in a segment nobody has
+// allocated yet, it allocates the segment and installs it with a
+// compare-and-swap, so a slow allocation never blocks other appenders, and
+// items never move.
+//
+// Each slot has a ready flag that's set once its item is written. The count
+// is the length of the prefix of ready slots, and it's advanced by whichever
+// appender finishes the last gap. Readers may use any item below the count
+// without locking, even while appends continue.
+//
+// On Windows builds, which don't use threads elsewhere in cstructs, the
+// atomic operations are plain loads and stores, and a ConcArray is not
+// thread-safe.
+//
+
+#pragma once
+
+#include <stdlib.h>
+
+#define concarray__max_segments 64
+
+typedef struct {
+  size_t item_size;
+  int    first_bits;  // Segment 0 holds 2 ^ first_bits items.
+  size_t reserved;    // The number of slots handed out.
+  size_t count;       // The number of leading slots that are ready.
+  char * segments[concarray__max_segments];
+} ConcArrayStruct;
+
+typedef ConcArrayStruct *ConcArray;
+
+// Returns NULL if the memory can't be allocated. These two are not
+// thread-safe.
+ConcArray concarray__new    (size_t first_capacity, size_t item_size);
+void      concarray__delete (ConcArray conc_array);
+
+// Appends num_items items, copied from items, and returns the index of the
+// first one. The appended items are contiguous in index order, and are
+// readable once the count passes them; this is usually right away, but can
+// wait on earlier appends that are still copying. Returns SIZE_MAX if a
+// segment can't be allocated; the count then stops advancing.
+size_t    concarray__append (ConcArray conc_array, const void *items,
+                             size_t num_items);
+#define   concarray__append_val(a, i) concarray__append(a, &i, 1)
+
+// The number of items that are safe to read.
+size_t    concarray__count  (ConcArray conc_array);
+
+// Expects index < concarray__count(conc_array).
+void *    concarray__item_ptr (ConcArray conc_array, size_t index);
+#define   concarray__item_val(a, i, type) \
+  (*(type *)concarray__item_ptr(a, i))
@@ -13,8 +13,23 @@ extern "C" {
 #endif
 
 #include "array.h"
+#include "arraysort.h"
+#include "bitset.h"
+#include "blobarray.h"
+#include "colarray.h"
+#include "concarray.h"
+#include "deque.h"
+#include "heap.h"
+#include "intern.h"
+#include "join.h"
+#include "latency.h"
 #include "list.h"
 #include "map.h"
+#include "map64.h"
+#include "packedarray.h"
+#include "searchindex.h"
+#include "segarray.h"
+#include "sortedset.h"
   
 #ifdef __cplusplus
 }
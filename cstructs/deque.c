@@ -0,0 +1,133 @@
+// deque.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "deque.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+
+// Internal functions.
+// ===================
+
+static char *slot_ptr(Deque deque, size_t slot) {
+  return deque->ring.items + (slot & (deque->ring.count - 1)) *
+                             deque->ring.item_size;
+}
+
+// Doubles the ring if it's full; returns 0 if it can't grow.
+static int make_room(Deque deque) {
+  size_t num_slots = deque->ring.count;
+  if (deque->count < num_slots) return 1;
+  if (num_slots > SIZE_MAX / 2 ||
+      !array__reserve(&deque->ring, 2 * num_slots)) {
+    return 0;
+  }
+
+  // The ring was full, so its last head items had wrapped around to slots 0
+  // to head - 1; move them to just past the old end. The new slots needn't
+  // be zeroed, as every slot is written before it's read.
+  size_t size = deque->ring.item_size;
+  memcpy(deque->ring.items + num_slots * size, deque->ring.items,
+         deque->head * size);
+  deque->ring.count = 2 * num_slots;
+  return 1;
+}
+
+static void release_items(Deque deque) {
+  if (deque->releaser == NULL) return;
+  for (size_t i = 0; i < deque->count; ++i) {
+    deque->releaser(deque__item_ptr(deque, i), NULL);
+  }
+}
+
+static void remove_slot(Deque deque, char *slot, void *item) {
+  if (item) {
+    memcpy(item, slot, deque->ring.item_size);
+  } else if (deque->releaser) {
+    deque->releaser(slot, NULL);
+  }
+  deque->count--;
+}
+
+
+// Public functions.
+// =================
+
+Deque deque__new(size_t capacity, size_t item_size) {
+  size_t num_slots = 1;
+  while (num_slots < capacity) {
+    if (num_slots > SIZE_MAX / 2) return NULL;
+    num_slots *= 2;
+  }
+  Deque deque = malloc(sizeof(DequeStruct));
+  if (deque == NULL) return NULL;
+  if (array__init(&deque->ring, num_slots, item_size) == NULL) {
+    free(deque);
+    return NULL;
+  }
+  deque->ring.count = num_slots;
+  deque->count      = 0;
+  deque->head       = 0;
+  deque->releaser   = NULL;
+  return deque;
+}
+
+void deque__delete(Deque deque) {
+  release_items(deque);
+  array__release(&deque->ring);
+  free(deque);
+}
+
+void deque__clear(Deque deque) {
+  release_items(deque);
+  deque->count = 0;
+  deque->head  = 0;
+}
+
+void *deque__item_ptr(Deque deque, size_t index) {
+  return slot_ptr(deque, deque->head + index);
+}
+
+void *deque__new_front(Deque deque) {
+  if (!make_room(deque)) return NULL;
+  deque->head = (deque->head - 1) & (deque->ring.count - 1);
+  deque->count++;
+  return slot_ptr(deque, deque->head);
+}
+
+void *deque__new_back(Deque deque) {
+  if (!make_room(deque)) return NULL;
+  return slot_ptr(deque, deque->head + deque->count++);
+}
+
+void *deque__push_front(Deque deque, void *item) {
+  void *slot = deque__new_front(deque);
+  if (slot) memcpy(slot, item, deque->ring.item_size);
+  return slot;
+}
+
+void *deque__push_back(Deque deque, void *item) {
+  void *slot = deque__new_back(deque);
+  if (slot) memcpy(slot, item, deque->ring.item_size);
+  return slot;
+}
+
+int deque__pop_front(Deque deque, void *item) {
+  if (deque->count == 0) return 0;
+  remove_slot(deque, slot_ptr(deque, deque->head), item);
+  deque->head = (deque->head + 1) & (deque->ring.count - 1);
+  return 1;
+}
+
+int deque__pop_back(Deque deque, void *item) {
+  if (deque->count == 0) return 0;
+  remove_slot(deque, slot_ptr(deque, deque->head + deque->count - 1), item);
+  return 1;
+}
@@ -0,0 +1,67 @@
+// deque.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A double-ended queue of fixed-size items with O(1) pushes and pops at both
+// ends and O(1) access by index.
+//
+// Items live in a ring buffer whose size is a power of two, so an index maps
+// to a slot with a mask rather than a division. The ring is an Array, and
+// grows the same way, including moving into a memory mapping once it's
+// large. When the ring doubles, the items that had wrapped around to its
+// start are copied to just past the old end, so that the items stay in one
+// unbroken run of slots.
+//
+// As with Array, the releaser, if set, is called on items the deque drops:
+// by deque__clear or deque__delete, or by a pop that is given a NULL item.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdlib.h>
+
+typedef struct {
+  size_t      count;
+  size_t      head;      // The ring slot of the front item.
+  Releaser    releaser;
+  ArrayStruct ring;      // ring.count is the number of slots, a power of two.
+} DequeStruct;
+
+typedef DequeStruct *Deque;
+
+// Returns NULL if the memory can't be allocated. The capacity is rounded up
+// to a power of two.
+Deque  deque__new    (size_t capacity, size_t item_size);
+void   deque__delete (Deque deque);  // Releases all items and frees deque.
+void   deque__clear  (Deque deque);  // Releases all items; count becomes 0.
+
+// The item at the given index, counting from the front.
+void * deque__item_ptr (Deque deque, size_t index);
+#define deque__item_val(deque, i, type) (*(type *)deque__item_ptr(deque, i))
+
+// These add a slot at one end and return a pointer to it, or return NULL if
+// the deque can't grow.
+void * deque__new_front (Deque deque);
+void * deque__new_back  (Deque deque);
+
+// These copy item into a new slot; they return the slot or NULL.
+void * deque__push_front (Deque deque, void *item);
+void * deque__push_back  (Deque deque, void *item);
+#define deque__push_front_val(d, i) deque__push_front(d, &i)
+#define deque__push_back_val(d, i)  deque__push_back(d, &i)
+
+// These remove the item at one end and return 1, or return 0 if the deque is
+// empty. The removed item is copied to *item, or is released if item is NULL.
+int    deque__pop_front (Deque deque, void *item);
+int    deque__pop_back  (Deque deque, void *item);
+
+// Loop over a deque from front to back.
+// Example: deque__for(item_type *, item_ptr, deque, index) { /* loop body */ }
+// As with array__for, pushes may invalidate item_ptr until the next iteration.
+#define deque__for(type, item_ptr, deque, index)                \
+  for (size_t index = 0, __tmpvar = 1; __tmpvar--;)             \
+  for (type item_ptr = (type)deque__item_ptr(deque, index);     \
+       index < (deque)->count;                                  \
+       item_ptr = (type)deque__item_ptr(deque, ++index))
@@ -0,0 +1,317 @@
+// heap.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// The item at slot i has its children at slots arity * i + 1 through
+// arity * i + arity, and its parent at slot (i - 1) / arity. Sifts move a
+// hole rather than swapping: the moving item is copied into scratch, each
+// item it passes is copied once into the hole, and the moving item is copied
+// back in at the end.
+//
+// When handles are used, the handles array follows the items, and slots maps
+// each handle back to its item's slot. A handle is in use exactly when its
+// slot is below the count and holds that handle; the slots entries of free
+// handles instead link them into a list, starting at free_handle.
+//
+
+#include "heap.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <string.h>
+
+
+// Internal functions.
+// ===================
+
+#define slot_ptr(heap, slot) \
+  ((heap)->items.items + (slot) * (heap)->items.item_size)
+
+#define handle_at(heap, slot) (((heap__Handle *)(heap)->handles.items)[slot])
+#define slot_of(heap, handle) (((size_t *)(heap)->slots.items)[handle])
+
+static int less(Heap heap, const void *a, const void *b) {
+  if (heap->compare) return heap->compare(heap->compare_context, a, b) < 0;
+  return memcmp(a, b, heap->items.item_size) < 0;
+}
+
+// Copies item, with its handle, into the given slot.
+static void place(Heap heap, size_t slot, const void *item,
+                  heap__Handle handle) {
+  memcpy(slot_ptr(heap, slot), item, heap->items.item_size);
+  if (heap->use_handles) {
+    handle_at(heap, slot) = handle;
+    slot_of(heap, handle) = slot;
+  }
+}
+
+static void move(Heap heap, size_t to, size_t from) {
+  place(heap, to, slot_ptr(heap, from),
+        heap->use_handles ? handle_at(heap, from) : 0);
+}
+
+// Moves the item at slot toward the top until its parent is no greater.
+// Returns the item's final slot.
+static size_t sift_up(Heap heap, size_t slot) {
+  size_t start = slot;
+  heap__Handle handle = heap->use_handles ? handle_at(heap, slot) : 0;
+  memcpy(heap->scratch, slot_ptr(heap, slot), heap->items.item_size);
+  while (slot > 0) {
+    size_t parent = (slot - 1) / heap->arity;
+    if (!less(heap, heap->scratch, slot_ptr(heap, parent))) break;
+    move(heap, slot, parent);
+    slot = parent;
+  }
+  if (slot != start) place(heap, slot, heap->scratch, handle);
+  return slot;
+}
+
+// Moves the item at slot away from the top until no child is less than it.
+static void sift_down(Heap heap, size_t slot) {
+  size_t count = heap->items.count;
+  size_t arity = heap->arity;
+  if (count < 2) return;
+  size_t start = slot;
+  heap__Handle handle = heap->use_handles ? handle_at(heap, slot) : 0;
+  memcpy(heap->scratch, slot_ptr(heap, slot), heap->items.item_size);
+
+  // A slot has children when its first child, arity * slot + 1, is below
+  // count; this test of that can't overflow.
+  while (slot <= (count - 2) / arity) {
+    size_t first = arity * slot + 1;
+    size_t end   = (count - first < arity) ? count : first + arity;
+    size_t least = first;
+    for (size_t child = first + 1; child < end; ++child) {
+      if (less(heap, slot_ptr(heap, child), slot_ptr(heap, least))) {
+        least = child;
+      }
+    }
+    if (!less(heap, slot_ptr(heap, least), heap->scratch)) break;
+    move(heap, slot, least);
+    slot = least;
+  }
+  if (slot != start) place(heap, slot, heap->scratch, handle);
+}
+
+// Restores heap order after the item at slot has changed.
+static void restore(Heap heap, size_t slot) {
+  if (sift_up(heap, slot) == slot) sift_down(heap, slot);
+}
+
+// Returns the slot of a handle's item, or heap__no_handle if it's free.
+static size_t find_slot(Heap heap, heap__Handle handle) {
+  if (!heap->use_handles || handle >= heap->slots.count) {
+    return heap__no_handle;
+  }
+  size_t slot = slot_of(heap, handle);
+  if (slot >= heap->items.count || handle_at(heap, slot) != handle) {
+    return heap__no_handle;
+  }
+  return slot;
+}
+
+// Returns a free handle, or heap__no_handle if slots can't grow.
+static heap__Handle new_handle(Heap heap) {
+  heap__Handle handle = heap->free_handle;
+  if (handle != heap__no_handle) {
+    heap->free_handle = slot_of(heap, handle);
+    return handle;
+  }
+  if (array__new_ptr(&heap->slots) == NULL) return heap__no_handle;
+  return heap->slots.count - 1;
+}
+
+static void free_handle(Heap heap, heap__Handle handle) {
+  slot_of(heap, handle) = heap->free_handle;
+  heap->free_handle     = handle;
+}
+
+// Removes the item at slot, moving the last item into its place.
+static void remove_slot(Heap heap, size_t slot, void *item) {
+  if (item) {
+    memcpy(item, slot_ptr(heap, slot), heap->items.item_size);
+  } else if (heap->releaser) {
+    heap->releaser(slot_ptr(heap, slot), NULL);
+  }
+  if (heap->use_handles) {
+    free_handle(heap, handle_at(heap, slot));
+    heap->handles.count--;
+  }
+  size_t last = --heap->items.count;
+  if (slot == last) return;
+  move(heap, slot, last);
+  restore(heap, slot);
+}
+
+static void release_items(Heap heap) {
+  if (heap->releaser == NULL) return;
+  Array items = &heap->items;
+  array__for(void *, item, items, i) heap->releaser(item, NULL);
+}
+
+// Copies item into the heap and returns 1, or returns 0 if the heap can't
+// grow. Sets *handle_out, if given, to the new item's handle.
+static int push(Heap heap, void *item, heap__Handle *handle_out) {
+  heap__Handle handle = 0;
+  if (heap->use_handles) {
+    if (array__new_ptr(&heap->handles) == NULL) return 0;
+    handle = new_handle(heap);
+    if (handle == heap__no_handle) {
+      heap->handles.count--;
+      return 0;
+    }
+  }
+  if (array__new_ptr(&heap->items) == NULL) {
+    if (heap->use_handles) {
+      free_handle(heap, handle);
+      heap->handles.count--;
+    }
+    return 0;
+  }
+  size_t slot = heap->items.count - 1;
+  place(heap, slot, item, handle);
+  sift_up(heap, slot);
+  if (handle_out) *handle_out = handle;
+  return 1;
+}
+
+static Heap alloc_heap(size_t capacity, size_t item_size, int arity,
+                       array__CompareFunction compare,
+                       void *compare_context) {
+  if (item_size == 0) item_size = 1;
+  // The scratch item follows the struct, padded so it's as aligned as
+  // malloc's.
+  size_t header = array__align_up(sizeof(HeapStruct));
+  if (item_size > SIZE_MAX - header) return NULL;
+  Heap heap = malloc(header + item_size);
+  if (heap == NULL) return NULL;
+  if (array__init(&heap->items, capacity, item_size) == NULL) {
+    free(heap);
+    return NULL;
+  }
+  heap->arity           = arity < 2 ? 2 : arity;
+  heap->compare         = compare;
+  heap->compare_context = compare_context;
+  heap->releaser        = NULL;
+  heap->scratch         = (char *)heap + header;
+  heap->use_handles     = 0;
+  heap->free_handle     = heap__no_handle;
+  return heap;
+}
+
+
+// Public functions.
+// =================
+
+Heap heap__new(size_t item_size, int arity,
+               array__CompareFunction compare, void *compare_context) {
+  return alloc_heap(0, item_size, arity, compare, compare_context);
+}
+
+Heap heap__new_from_array(Array array, int arity,
+                          array__CompareFunction compare,
+                          void *compare_context) {
+  Heap heap = alloc_heap(array->count, array->item_size, arity, compare,
+                         compare_context);
+  if (heap == NULL) return NULL;
+  if (array->count) {
+    memcpy(heap->items.items, array->items, array->count * array->item_size);
+    heap->items.count = array->count;
+  }
+
+  // Sifting down each parent, last to first, takes O(n) time in total.
+  size_t count = heap->items.count;
+  if (count < 2) return heap;
+  for (size_t slot = (count - 2) / heap->arity + 1; slot-- > 0;) {
+    sift_down(heap, slot);
+  }
+  return heap;
+}
+
+void heap__delete(Heap heap) {
+  release_items(heap);
+  array__release(&heap->items);
+  if (heap->use_handles) {
+    array__release(&heap->handles);
+    array__release(&heap->slots);
+  }
+  free(heap);
+}
+
+void heap__clear(Heap heap) {
+  release_items(heap);
+  heap->items.count = 0;
+  if (heap->use_handles) {
+    heap->handles.count = 0;
+    heap->slots.count   = 0;
+    heap->free_handle   = heap__no_handle;
+  }
+}
+
+int heap__use_handles(Heap heap) {
+  if (heap->items.count) return 0;
+  if (heap->use_handles) return 1;
+  if (array__init(&heap->handles, 0, sizeof(heap__Handle)) == NULL) return 0;
+  if (array__init(&heap->slots, 0, sizeof(size_t)) == NULL) {
+    array__release(&heap->handles);
+    return 0;
+  }
+  heap->use_handles = 1;
+  return 1;
+}
+
+void *heap__top(Heap heap) {
+  return heap->items.count ? heap->items.items : NULL;
+}
+
+int heap__push(Heap heap, void *item) {
+  return push(heap, item, NULL);
+}
+
+heap__Handle heap__push_handle(Heap heap, void *item) {
+  heap__Handle handle;
+  if (!heap->use_handles || !push(heap, item, &handle)) return heap__no_handle;
+  return handle;
+}
+
+int heap__pop(Heap heap, void *item) {
+  if (heap->items.count == 0) return 0;
+  remove_slot(heap, 0, item);
+  return 1;
+}
+
+heap__Handle heap__top_handle(Heap heap) {
+  if (!heap->use_handles || heap->items.count == 0) return heap__no_handle;
+  return handle_at(heap, 0);
+}
+
+void *heap__handle_ptr(Heap heap, heap__Handle handle) {
+  size_t slot = find_slot(heap, handle);
+  return slot == heap__no_handle ? NULL : slot_ptr(heap, slot);
+}
+
+int heap__decrease_key(Heap heap, heap__Handle handle, void *item) {
+  size_t slot = find_slot(heap, handle);
+  if (slot == heap__no_handle) return 0;
+  memcpy(slot_ptr(heap, slot), item, heap->items.item_size);
+  sift_up(heap, slot);
+  return 1;
+}
+
+int heap__update(Heap heap, heap__Handle handle, void *item) {
+  size_t slot = find_slot(heap, handle);
+  if (slot == heap__no_handle) return 0;
+  memcpy(slot_ptr(heap, slot), item, heap->items.item_size);
+  restore(heap, slot);
+  return 1;
+}
+
+int heap__remove(Heap heap, heap__Handle handle, void *item) {
+  size_t slot = find_slot(heap, handle);
+  if (slot == heap__no_handle) return 0;
+  remove_slot(heap, slot, item);
+  return 1;
+}
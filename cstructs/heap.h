@@ -0,0 +1,109 @@
+// heap.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A priority queue of fixed-size items, kept as an implicit d-ary heap in an
+// Array. Pushes and pops take O(log n) compares, the top item is read in O(1)
+// time, and a heap can be built from an existing Array in O(n) time.
+//
+// The top item is the least one according to the compare function, which is
+// given the compare context as its first argument, as in array__sort; a NULL
+// compare means memcmp order. Reversing the compare function gives a max-heap.
+//
+// The arity is the number of children each node has. A binary heap (arity 2)
+// makes the fewest compares per pop, while a 4-ary or 8-ary heap is half or a
+// third as deep, and its children sit next to each other in memory, so pushes
+// and pops touch fewer cache lines on large heaps.
+//
+// After heap__use_handles, every item is given a handle when it's pushed. The
+// handle follows the item as it moves through the heap, so that the item can
+// later be found, changed, or removed in O(log n) time; this is the
+// decrease-key operation used by timers and by Dijkstra's algorithm. A handle
+// is freed, and may be reused, once its item leaves the heap.
+//
+// As with Array, the releaser, if set, is called on items the heap drops:
+// by heap__clear or heap__delete, or by a pop or removal given a NULL item.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef size_t heap__Handle;
+
+#define heap__no_handle SIZE_MAX
+
+typedef struct {
+  ArrayStruct            items;        // Heap order; items.count is the count.
+  int                    arity;
+  array__CompareFunction compare;
+  void *                 compare_context;
+  Releaser               releaser;
+  char *                 scratch;      // Holds an item while it's being sifted.
+
+  // These are only used after heap__use_handles.
+  int                    use_handles;
+  ArrayStruct            handles;      // The handle of the item at each slot.
+  ArrayStruct            slots;        // The slot of each handle's item.
+  heap__Handle           free_handle;  // The first free handle, if any.
+} HeapStruct;
+
+typedef HeapStruct *Heap;
+
+// These return NULL if the memory can't be allocated. An arity below 2 is
+// treated as 2.
+Heap   heap__new    (size_t item_size, int arity,
+                     array__CompareFunction compare, void *compare_context);
+
+// Copies the items of array into a new heap and puts them in heap order in
+// O(n) time. The array is left unchanged.
+Heap   heap__new_from_array(Array array, int arity,
+                            array__CompareFunction compare,
+                            void *compare_context);
+
+void   heap__delete (Heap heap);  // Releases all items and frees heap.
+void   heap__clear  (Heap heap);  // Releases all items; count becomes 0.
+
+#define heap__count(heap) ((heap)->items.count)
+
+// Turns on handles. Expects an empty heap; returns 0 if it isn't empty or
+// the memory can't be allocated.
+int    heap__use_handles (Heap heap);
+
+// Returns the least item, or NULL if the heap is empty. The item may be read
+// but not changed in place; use heap__update to change it.
+void * heap__top (Heap heap);
+
+// Copies item into the heap. The first returns 1, or 0 if the heap can't
+// grow; the second returns the new item's handle, or heap__no_handle if the
+// heap can't grow or isn't using handles.
+int          heap__push        (Heap heap, void *item);
+heap__Handle heap__push_handle (Heap heap, void *item);
+#define      heap__push_val(heap, i) heap__push(heap, &i)
+
+// Removes the least item and returns 1, or returns 0 if the heap is empty.
+// The removed item is copied to *item, or is released if item is NULL.
+int    heap__pop (Heap heap, void *item);
+
+// Functions on handles, for heaps using them. A handle whose item has left
+// the heap is stale, and a stale handle may be reused by a later push.
+
+// The handle of the least item, or heap__no_handle if the heap is empty.
+heap__Handle heap__top_handle (Heap heap);
+
+// Returns the item with the given handle, or NULL if the handle is free.
+void * heap__handle_ptr (Heap heap, heap__Handle handle);
+
+// These replace the item with the given handle by item, keep its handle, and
+// restore heap order. heap__decrease_key expects the new item to be no
+// greater than the old one, and only moves it toward the top; heap__update
+// accepts any new item. Both return 0 if the handle is free.
+int    heap__decrease_key (Heap heap, heap__Handle handle, void *item);
+int    heap__update       (Heap heap, heap__Handle handle, void *item);
+
+// Removes the item with the given handle and returns 1, or returns 0 if the
+// handle is free. The item is copied or released as in heap__pop.
+int    heap__remove (Heap heap, heap__Handle handle, void *item);
@@ -0,0 +1,117 @@
+// intern.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "intern.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#define lock_of(intern)    ((pthread_rwlock_t *)(intern)->lock)
+#define read_lock(intern)  pthread_rwlock_rdlock(lock_of(intern))
+#define write_lock(intern) pthread_rwlock_wrlock(lock_of(intern))
+#define unlock(intern)     pthread_rwlock_unlock(lock_of(intern))
+#else
+#define read_lock(intern)
+#define write_lock(intern)
+#define unlock(intern)
+#endif
+
+
+// Internal functions.
+// ===================
+
+// This is the 32-bit FNV-1a hash.
+static int str_hash(void *str_void_ptr) {
+  unsigned char *str = (unsigned char *)str_void_ptr;
+  uint32_t h = 2166136261u;
+  while (*str) {
+    h ^= *str++;
+    h *= 16777619u;
+  }
+  return (int)h;
+}
+
+static int str_eq(void *str1, void *str2) {
+  return !strcmp((char *)str1, (char *)str2);
+}
+
+static void free_str(void *str, void *context) {
+  free(str);
+}
+
+
+// Public functions.
+// =================
+
+Intern intern__new() {
+  Intern intern = malloc(sizeof(InternStruct));
+  intern->map = map__new(str_hash, str_eq);
+  intern->map->key_releaser = free_str;
+#ifndef _WIN32
+  intern->lock = malloc(sizeof(pthread_rwlock_t));
+  pthread_rwlock_init(lock_of(intern), NULL);
+#else
+  intern->lock = NULL;
+#endif
+  return intern;
+}
+
+void intern__delete(Intern intern) {
+  map__delete(intern->map);
+#ifndef _WIN32
+  pthread_rwlock_destroy(lock_of(intern));
+  free(intern->lock);
+#endif
+  free(intern);
+}
+
+const char *intern__get(Intern intern, const char *str) {
+  const char *canonical = intern__find(intern, str);
+  if (canonical) return canonical;
+
+  write_lock(intern);
+  // Another thread may have added str since we released the read lock.
+  map__key_value *pair = map__get(intern->map, (void *)str);
+  if (pair) {
+    canonical = pair->key;
+  } else {
+    char *copy = strdup(str);
+    map__set(intern->map, copy, copy);
+    canonical = copy;
+  }
+  unlock(intern);
+  return canonical;
+}
+
+const char *intern__find(Intern intern, const char *str) {
+  read_lock(intern);
+  map__key_value *pair = map__get(intern->map, (void *)str);
+  unlock(intern);
+  return pair ? pair->key : NULL;
+}
+
+int intern__count(Intern intern) {
+  read_lock(intern);
+  int count = intern->map->count;
+  unlock(intern);
+  return count;
+}
+
+int intern__ptr_hash(void *str) {
+  // Mix the address so that the alignment zeros in its low bits don't all
+  // land in the same buckets.
+  uint64_t h = (uint64_t)(uintptr_t)str * 0x9e3779b97f4a7c15ull;
+  return (int)(h >> 32);
+}
+
+int intern__ptr_eq(void *str1, void *str2) {
+  return str1 == str2;
+}
@@ -0,0 +1,39 @@
+// intern.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A string interning table. Each distinct string is stored once, and
+// intern__get always returns the same pointer for equal strings, so interned
+// strings can be compared and hashed by address alone.
+//
+// Lookups take a shared read lock, so any number of threads may intern
+// strings at once; only the first insertion of a new string takes the
+// write lock. Thread safety needs pthreads, and is unavailable on Windows.
+//
+
+#pragma once
+
+#include "map.h"
+
+typedef struct {
+  Map    map;   // Maps each canonical string to itself; it owns the strings.
+  void * lock;  // A pthread_rwlock_t *.
+} InternStruct;
+
+typedef InternStruct *Intern;
+
+Intern       intern__new    ();
+void         intern__delete (Intern intern);  // Frees all interned strings.
+
+// Returns the canonical copy of str, making one if str is new.
+const char * intern__get    (Intern intern, const char *str);
+
+// Returns the canonical copy of str, or NULL if str has not been interned.
+const char * intern__find   (Intern intern, const char *str);
+
+int          intern__count  (Intern intern);
+
+// Hash and equality functions for Maps whose keys are all interned strings.
+// Example: Map map = map__new(intern__ptr_hash, intern__ptr_eq);
+int intern__ptr_hash (void *str);
+int intern__ptr_eq   (void *str1, void *str2);
@@ -0,0 +1,41 @@
+// internal.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Helpers shared by the cstructs source files. This isn't part of the public
+// interface, and cstructs.h doesn't include it.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+// Marks a helper that must be inlined into its caller, such as a SIMD kernel
+// whose width parameter is meant to become a constant. Compilers without the
+// attribute get a plain inline hint.
+#if defined(__GNUC__)
+#define always_inline inline __attribute__((always_inline))
+#else
+#define always_inline inline
+#endif
+
+// Returns the index of the highest set bit in x, which must be nonzero.
+static inline int highest_bit(size_t x) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll((unsigned long long)x);
+#else
+  int i = 0;
+  while (x >>= 1) ++i;
+  return i;
+#endif
+}
+
+// In a SegArray or ConcArray, segment k holds 2 ^ (first_bits + k) items.
+// Returns the segment of the item at index, and sets *offset to the item's
+// index within that segment.
+static inline int segment_of(int first_bits, size_t index, size_t *offset) {
+  size_t shifted = index + ((size_t)1 << first_bits);
+  int top = highest_bit(shifted);
+  *offset = shifted - ((size_t)1 << top);
+  return top - first_bits;
+}
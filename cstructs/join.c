@@ -0,0 +1,346 @@
+// join.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// Each input Array is summarized as an array of entries, one per item,
+// holding the item's key hash and index. The entries are scattered into
+// partitions keyed by the top bits of the hash. The number of partitions is
+// chosen so that a partition's entries plus its hash table fit in about
+// PARTITION_BYTES. A partition's hash table is open-addressed with linear
+// probing on the low bits of the hash, and is sized up front to twice the
+// number of entries it will hold.
+//
+
+#include "join.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define PARTITION_BYTES (256 * 1024)
+#define MAX_PARTITION_BITS 12
+#define MIN_TABLE_SIZE 16
+
+
+// Internal types.
+// ===============
+
+typedef struct {
+  uint64_t hash;
+  size_t   index;  // The item's index in its Array.
+  int      group;  // A partition-local group id; only used by group_by.
+} Entry;
+
+typedef struct {
+  Array    array;
+  Entry *  entries;  // Grouped by partition.
+  size_t * starts;   // Partition p owns entries starts[p] to starts[p + 1] - 1.
+} Partitioned;
+
+typedef struct {
+  size_t               key_offset;
+  size_t               key_size;
+  int                  partition_bits;
+  int                  num_partitions;
+  Partitioned          build;
+  Partitioned          probe;  // Unused by group_by.
+  array__JoinFunction  emit;
+  array__GroupFunction agg;
+  void *               context;
+  int *                group_starts;  // Partition p's first global group id.
+  void (*process)(void *job, void *scratch, int partition);
+  int                  next_partition;
+} Job;
+
+typedef struct {
+  int *  slots;
+  size_t capacity;
+} Scratch;
+
+
+// Internal functions.
+// ===================
+
+static uint64_t hash_key(const char *key, size_t size) {
+  uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+  uint64_t word;
+  for (; size >= 8; key += 8, size -= 8) {
+    memcpy(&word, key, 8);
+    h = (h ^ word) * 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 31;
+  }
+  if (size) {
+    word = 0;
+    memcpy(&word, key, size);
+    h = (h ^ word) * 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 31;
+  }
+  // This is the 64-bit finalizer from MurmurHash3.
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+static int partition_bits_for(size_t count) {
+  size_t bytes_per_item = sizeof(Entry) + 2 * sizeof(int);
+  int bits = 0;
+  while (bits < MAX_PARTITION_BITS &&
+         (count * bytes_per_item >> bits) > PARTITION_BYTES) {
+    ++bits;
+  }
+  return bits;
+}
+
+static int partition_of(uint64_t hash, int bits) {
+  return bits ? (int)(hash >> (64 - bits)) : 0;
+}
+
+static void partition(Partitioned *p, Array array, Job *job) {
+  size_t n = array->count;
+  p->array   = array;
+  p->entries = malloc(n * sizeof(Entry));
+  p->starts  = calloc(job->num_partitions + 1, sizeof(size_t));
+
+  uint64_t *hashes = malloc(n * sizeof(uint64_t));
+  for (size_t i = 0; i < n; ++i) {
+    char *key = (char *)array__item_ptr(array, i) + job->key_offset;
+    hashes[i] = hash_key(key, job->key_size);
+    p->starts[partition_of(hashes[i], job->partition_bits) + 1]++;
+  }
+  for (int i = 0; i < job->num_partitions; ++i) {
+    p->starts[i + 1] += p->starts[i];
+  }
+
+  // A stable scatter, so each partition keeps the original item order.
+  size_t *cursor = malloc(job->num_partitions * sizeof(size_t));
+  memcpy(cursor, p->starts, job->num_partitions * sizeof(size_t));
+  for (size_t i = 0; i < n; ++i) {
+    int part = partition_of(hashes[i], job->partition_bits);
+    Entry *e = &p->entries[cursor[part]++];
+    e->hash  = hashes[i];
+    e->index = i;
+    e->group = -1;
+  }
+  free(cursor);
+  free(hashes);
+}
+
+static void release_partitioned(Partitioned *p) {
+  free(p->entries);
+  free(p->starts);
+}
+
+static void *key_of(Job *job, Partitioned *p, Entry *e) {
+  return (char *)array__item_ptr(p->array, e->index) + job->key_offset;
+}
+
+// Returns a cleared table with room for num_entries entries; the size is
+// written to *size, and is always a power of two.
+static int *table_for(Scratch *scratch, int num_entries, size_t *size) {
+  *size = MIN_TABLE_SIZE;
+  while (*size < 2 * (size_t)num_entries) *size *= 2;
+  if (*size > scratch->capacity) {
+    free(scratch->slots);
+    scratch->slots = malloc(*size * sizeof(int));
+    scratch->capacity = *size;
+  }
+  memset(scratch->slots, 0xff, *size * sizeof(int));  // Every slot is now -1.
+  return scratch->slots;
+}
+
+static void join_partition(void *job_ptr, void *scratch, int partition) {
+  Job *job = (Job *)job_ptr;
+  Entry *build = job->build.entries + job->build.starts[partition];
+  Entry *probe = job->probe.entries + job->probe.starts[partition];
+  int num_build =
+      job->build.starts[partition + 1] - job->build.starts[partition];
+  int num_probe =
+      job->probe.starts[partition + 1] - job->probe.starts[partition];
+  if (num_build == 0 || num_probe == 0) return;
+
+  size_t size;
+  int *slots = table_for((Scratch *)scratch, num_build, &size);
+  size_t mask = size - 1;
+  for (int i = 0; i < num_build; ++i) {
+    size_t slot = build[i].hash & mask;
+    while (slots[slot] != -1) slot = (slot + 1) & mask;
+    slots[slot] = i;
+  }
+
+  for (int i = 0; i < num_probe; ++i) {
+    void *probe_key = key_of(job, &job->probe, &probe[i]);
+    for (size_t slot = probe[i].hash & mask;
+         slots[slot] != -1;
+         slot = (slot + 1) & mask) {
+      Entry *b = &build[slots[slot]];
+      if (b->hash != probe[i].hash) continue;
+      if (memcmp(key_of(job, &job->build, b), probe_key, job->key_size)) {
+        continue;
+      }
+      job->emit(array__item_ptr(job->build.array, b->index),
+                array__item_ptr(job->probe.array, probe[i].index),
+                job->context);
+    }
+  }
+}
+
+// Sets each entry's partition-local group id; the partition's group count is
+// stored in group_starts[partition + 1] until the prefix sums are taken.
+static void group_partition(void *job_ptr, void *scratch, int partition) {
+  Job *job = (Job *)job_ptr;
+  Entry *entries = job->build.entries + job->build.starts[partition];
+  int num_entries =
+      job->build.starts[partition + 1] - job->build.starts[partition];
+  int num_groups = 0;
+
+  size_t size;
+  int *slots = table_for((Scratch *)scratch, num_entries, &size);
+  size_t mask = size - 1;
+  for (int i = 0; i < num_entries; ++i) {
+    void *key = key_of(job, &job->build, &entries[i]);
+    size_t slot = entries[i].hash & mask;
+    for (; slots[slot] != -1; slot = (slot + 1) & mask) {
+      Entry *rep = &entries[slots[slot]];
+      if (rep->hash == entries[i].hash &&
+          memcmp(key_of(job, &job->build, rep), key, job->key_size) == 0) {
+        entries[i].group = rep->group;
+        break;
+      }
+    }
+    if (slots[slot] == -1) {
+      slots[slot] = i;
+      entries[i].group = num_groups++;
+    }
+  }
+  job->group_starts[partition + 1] = num_groups;
+}
+
+static void aggregate_partition(void *job_ptr, void *scratch, int partition) {
+  Job *job = (Job *)job_ptr;
+  int first_group = job->group_starts[partition];
+  for (size_t i = job->build.starts[partition];
+       i < job->build.starts[partition + 1];
+       ++i) {
+    Entry *e = &job->build.entries[i];
+    job->agg(first_group + e->group,
+             array__item_ptr(job->build.array, e->index),
+             job->context);
+  }
+}
+
+static int claim_partition(Job *job) {
+#ifdef _WIN32
+  return job->next_partition++;
+#else
+  return __sync_fetch_and_add(&job->next_partition, 1);
+#endif
+}
+
+static void *work(void *job_ptr) {
+  Job *job = (Job *)job_ptr;
+  Scratch scratch = { NULL, 0 };
+  for (int p = claim_partition(job);
+       p < job->num_partitions;
+       p = claim_partition(job)) {
+    job->process(job, &scratch, p);
+  }
+  free(scratch.slots);
+  return NULL;
+}
+
+// Runs job->process on every partition, using up to num_threads threads.
+static void run(Job *job, void (*process)(void *, void *, int),
+                int num_threads) {
+  job->process = process;
+  job->next_partition = 0;
+#ifndef _WIN32
+  if (num_threads > job->num_partitions) num_threads = job->num_partitions;
+  if (num_threads > 1) {
+    pthread_t *threads = malloc((num_threads - 1) * sizeof(pthread_t));
+    for (int i = 0; i < num_threads - 1; ++i) {
+      pthread_create(&threads[i], NULL, work, job);
+    }
+    work(job);
+    for (int i = 0; i < num_threads - 1; ++i) pthread_join(threads[i], NULL);
+    free(threads);
+    return;
+  }
+#endif
+  work(job);
+}
+
+static void init_job(Job *job, Array build, size_t key_offset,
+                     size_t key_size, void *context) {
+  memset(job, 0, sizeof(Job));
+  job->key_offset = key_offset;
+  job->key_size   = key_size;
+  job->context    = context;
+  job->partition_bits = partition_bits_for(build->count);
+  job->num_partitions = 1 << job->partition_bits;
+  partition(&job->build, build, job);
+}
+
+
+// Public functions.
+// =================
+
+void array__hash_join(Array build, Array probe,
+                      size_t key_offset, size_t key_size,
+                      array__JoinFunction emit, void *context) {
+  array__hash_join_parallel(build, probe, key_offset, key_size,
+                            emit, context, 1);  // 1 --> num_threads
+}
+
+int array__group_by(Array array,
+                    size_t key_offset, size_t key_size,
+                    array__GroupFunction agg, void *context) {
+  return array__group_by_parallel(array, key_offset, key_size,
+                                  agg, context, 1);  // 1 --> num_threads
+}
+
+void array__hash_join_parallel(Array build, Array probe,
+                               size_t key_offset, size_t key_size,
+                               array__JoinFunction emit, void *context,
+                               int num_threads) {
+  Job job;
+  init_job(&job, build, key_offset, key_size, context);
+  job.emit = emit;
+  partition(&job.probe, probe, &job);
+
+  run(&job, join_partition, num_threads);
+
+  release_partitioned(&job.build);
+  release_partitioned(&job.probe);
+}
+
+int array__group_by_parallel(Array array,
+                             size_t key_offset, size_t key_size,
+                             array__GroupFunction agg, void *context,
+                             int num_threads) {
+  Job job;
+  init_job(&job, array, key_offset, key_size, context);
+  job.agg = agg;
+  job.group_starts = calloc(job.num_partitions + 1, sizeof(int));
+
+  run(&job, group_partition, num_threads);
+  for (int p = 0; p < job.num_partitions; ++p) {
+    job.group_starts[p + 1] += job.group_starts[p];
+  }
+  int num_groups = job.group_starts[job.num_partitions];
+  if (agg) run(&job, aggregate_partition, num_threads);
+
+  free(job.group_starts);
+  release_partitioned(&job.build);
+  return num_groups;
+}
@@ -0,0 +1,53 @@
+// join.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Hash join and group-by operators over Arrays of fixed-size records.
+//
+// Records are keyed by the key_size bytes starting key_offset bytes into each
+// item; two keys are equal when those bytes are equal. Both operators first
+// radix-partition the records on the high bits of the key hash so that each
+// partition's hash table fits in cache, then handle one partition at a time.
+// A consequence is that callbacks arrive grouped by partition rather than in
+// array order.
+//
+// The *_parallel variants spread the partitions across num_threads threads.
+// Callbacks may then run concurrently, but every callback that involves a
+// given key happens on the same thread.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdlib.h>
+
+// Called once for every (build, probe) pair of items with equal keys.
+typedef void (*array__JoinFunction)(void *build_item,
+                                    void *probe_item,
+                                    void *context);
+
+// Called once per item; group is the index of the item's key among all
+// distinct keys.
+typedef void (*array__GroupFunction)(int group, void *item, void *context);
+
+void array__hash_join(Array build, Array probe,
+                      size_t key_offset, size_t key_size,
+                      array__JoinFunction emit, void *context);
+
+// Returns the number of groups. Group indexes run from 0 to that number
+// minus 1, but are not in order of first appearance. The array may have any
+// number of items, but at most INT_MAX distinct keys.
+int  array__group_by(Array array,
+                     size_t key_offset, size_t key_size,
+                     array__GroupFunction agg, void *context);
+
+void array__hash_join_parallel(Array build, Array probe,
+                               size_t key_offset, size_t key_size,
+                               array__JoinFunction emit, void *context,
+                               int num_threads);
+
+int  array__group_by_parallel(Array array,
+                              size_t key_offset, size_t key_size,
+                              array__GroupFunction agg, void *context,
+                              int num_threads);
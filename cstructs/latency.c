@@ -0,0 +1,157 @@
+// latency.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "latency.h"
+
+#include <string.h>
+
+// Platform-specific includes and helpers.
+#ifdef _MSC_VER
+#include <intrin.h>
+#define thread_local __declspec(thread)
+#else
+#define thread_local __thread
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#ifndef _MSC_VER
+#include <x86intrin.h>
+#endif
+#define use_rdtsc 1
+#else
+#include <time.h>
+#define use_rdtsc 0
+#endif
+
+#define sub_count (1 << latency__sub_bits)
+
+static thread_local LatencyHistStruct thread_hists[latency__num_ops];
+
+static const char *op_names[latency__num_ops] = {
+  "map__set", "map__get", "map__unset", "array__new_ptr"
+};
+
+
+// Internal functions.
+// ===================
+
+static int highest_bit(uint64_t x) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse64(&index, x);
+  return (int)index;
+#else
+  return 63 - __builtin_clzll(x);
+#endif
+}
+
+static int bucket_index(uint64_t ticks) {
+  if (ticks < sub_count) return (int)ticks;
+  int shift = highest_bit(ticks) - latency__sub_bits;
+  return ((shift + 1) << latency__sub_bits) +
+         (int)((ticks >> shift) & (sub_count - 1));
+}
+
+// Returns the largest value that lands in the given bucket.
+static uint64_t bucket_max(int index) {
+  if (index < sub_count) return (uint64_t)index;
+  int shift = (index >> latency__sub_bits) - 1;
+  uint64_t low = (uint64_t)(sub_count + (index & (sub_count - 1))) << shift;
+  return low + (((uint64_t)1 << shift) - 1);
+}
+
+
+// Public functions.
+// =================
+
+void latency__hist_clear(LatencyHist hist) {
+  memset(hist, 0, sizeof(LatencyHistStruct));
+}
+
+void latency__hist_record(LatencyHist hist, uint64_t ticks) {
+  if (hist->count == 0 || ticks < hist->min) hist->min = ticks;
+  if (ticks > hist->max) hist->max = ticks;
+  hist->count++;
+  hist->sum += ticks;
+  hist->buckets[bucket_index(ticks)]++;
+}
+
+void latency__hist_merge(LatencyHist dst, LatencyHist src) {
+  if (src->count == 0) return;
+  if (dst->count == 0 || src->min < dst->min) dst->min = src->min;
+  if (src->max > dst->max) dst->max = src->max;
+  dst->count += src->count;
+  dst->sum   += src->sum;
+  for (int i = 0; i < latency__num_buckets; ++i) {
+    dst->buckets[i] += src->buckets[i];
+  }
+}
+
+uint64_t latency__hist_percentile(LatencyHist hist, double percentile) {
+  if (hist->count == 0) return 0;
+  if (percentile < 0)   percentile = 0;
+  if (percentile > 100) percentile = 100;
+
+  // The rank is the 1-based position of the value we want in sorted order.
+  uint64_t rank = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+  if (rank < 1) rank = 1;
+  if (rank > hist->count) rank = hist->count;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < latency__num_buckets; ++i) {
+    seen += hist->buckets[i];
+    if (seen >= rank) {
+      uint64_t val = bucket_max(i);
+      return val > hist->max ? hist->max : val;
+    }
+  }
+  return hist->max;
+}
+
+void latency__hist_dump(LatencyHist hist, const char *name, FILE *out) {
+  double mean = hist->count ? (double)hist->sum / hist->count : 0.0;
+  fprintf(out, "%-16s count=%llu min=%llu mean=%.1f p50=%llu p90=%llu "
+               "p99=%llu p999=%llu max=%llu\n",
+          name,
+          (unsigned long long)hist->count,
+          (unsigned long long)hist->min,
+          mean,
+          (unsigned long long)latency__hist_percentile(hist, 50.0),
+          (unsigned long long)latency__hist_percentile(hist, 90.0),
+          (unsigned long long)latency__hist_percentile(hist, 99.0),
+          (unsigned long long)latency__hist_percentile(hist, 99.9),
+          (unsigned long long)hist->max);
+}
+
+LatencyHist latency__thread_hist(latency__Op op) {
+  return &thread_hists[op];
+}
+
+const char *latency__op_name(latency__Op op) {
+  return op_names[op];
+}
+
+void latency__dump(FILE *out) {
+  for (int op = 0; op < latency__num_ops; ++op) {
+    if (thread_hists[op].count == 0) continue;
+    latency__hist_dump(&thread_hists[op], op_names[op], out);
+  }
+}
+
+void latency__reset() {
+  for (int op = 0; op < latency__num_ops; ++op) {
+    latency__hist_clear(&thread_hists[op]);
+  }
+}
+
+uint64_t latency__now() {
+#if use_rdtsc
+  return (uint64_t)__rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
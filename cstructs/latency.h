@@ -0,0 +1,85 @@
+// latency.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Per-operation latency histograms for the Array and Map hot paths.
+//
+// When the library is built with -D LATENCY_PROFILE, each call to
+// map__set, map__get, map__unset, and array__new_ptr records its duration
+// in ticks into a histogram owned by the calling thread. Without that flag
+// the hooks compile away to nothing; the histogram functions themselves are
+// always available, so you can also use them to time your own code.
+//
+// A tick is a cycle count from rdtsc on x86, and nanoseconds from a monotonic
+// clock elsewhere.
+//
+// Buckets are log-linear, in the style of HDR histograms: every power of two
+// is split into 2^latency__sub_bits equal sub-buckets, so any reported
+// value is within a factor of 1 + 1/2^latency__sub_bits of the true value.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define latency__sub_bits    3
+#define latency__num_buckets ((64 - latency__sub_bits + 1) << latency__sub_bits)
+
+typedef enum {
+  latency__map_set,
+  latency__map_get,
+  latency__map_unset,
+  latency__array_new_ptr,
+  latency__num_ops
+} latency__Op;
+
+typedef struct {
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+  uint64_t buckets[latency__num_buckets];
+} LatencyHistStruct;
+
+typedef LatencyHistStruct *LatencyHist;
+
+
+// Working with a single histogram.
+
+void     latency__hist_clear      (LatencyHist hist);
+void     latency__hist_record     (LatencyHist hist, uint64_t ticks);
+void     latency__hist_merge      (LatencyHist dst, LatencyHist src);
+
+// Returns an upper bound on the given percentile, which is in the range
+// [0, 100]; e.g. 99.9 gives the p999 latency. Returns 0 for empty histograms.
+uint64_t latency__hist_percentile (LatencyHist hist, double percentile);
+
+// Prints a one-line summary: count, min, mean, p50, p90, p99, p999, and max.
+void     latency__hist_dump       (LatencyHist hist, const char *name, FILE *out);
+
+
+// Working with the per-thread histograms filled in by LATENCY_PROFILE builds.
+
+// Returns the calling thread's histogram for op. To combine threads, have each
+// thread merge its histograms into a shared total with latency__hist_merge.
+LatencyHist  latency__thread_hist (latency__Op op);
+const char * latency__op_name     (latency__Op op);
+
+void latency__dump  (FILE *out);  // Dumps this thread's non-empty histograms.
+void latency__reset ();           // Clears this thread's histograms.
+
+uint64_t latency__now();
+
+
+// Internal hooks used by array.c and map.c.
+
+#ifdef LATENCY_PROFILE
+#define latency__start() uint64_t latency__start_ticks = latency__now()
+#define latency__end(op) \
+  latency__hist_record(latency__thread_hist(op), \
+                       latency__now() - latency__start_ticks)
+#else
+#define latency__start()
+#define latency__end(op)
+#endif
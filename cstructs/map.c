@@ -17,6 +17,7 @@
 #include "memprofile.h"
 #endif
 
+#include "latency.h"
 #include "list.h"
 
 #define MIN_BUCKETS 16
@@ -63,6 +64,7 @@ void map__delete(Map map) {
 }
 
 map__key_value *map__set(Map map, void *key, void *value) {
+  latency__start();
   int h = map->hash(key);
   List *entry = find_with_hash(map, key, h);
   map__key_value *pair;
@@ -76,7 +78,6 @@ map__key_value *map__set(Map map, void *key, void *value) {
       map->value_releaser(pair->value, NULL);
     }
     pair->value = value;
-    return pair;
   } else {
     // New pair.
     pair = map->pair_alloc(sizeof(map__key_value));
@@ -92,21 +93,28 @@ map__key_value *map__set(Map map, void *key, void *value) {
     list__insert(bucket, pair);
     map->count++;
   }
+  latency__end(latency__map_set);
   return pair;
 }
 
 void map__unset(Map map, void *key) {
+  latency__start();
   int h = map->hash(key);
   List *entry = find_with_hash(map, key, h);
-  if (entry == NULL) return;
-  release_and_free_pair(map, (*entry)->item);
-  list__remove_first(entry);
-  map->count--;
+  if (entry) {
+    release_and_free_pair(map, (*entry)->item);
+    list__remove_first(entry);
+    map->count--;
+  }
+  latency__end(latency__map_unset);
 }
 
 map__key_value *map__get(Map map, void *needle) {
+  latency__start();
   List *entry = find_with_hash(map, needle, map->hash(needle));
-  return entry ? (*entry)->item : NULL;
+  map__key_value *pair = entry ? (*entry)->item : NULL;
+  latency__end(latency__map_get);
+  return pair;
 }
 
 void map__clear(Map map) {
@@ -121,11 +129,12 @@ map__key_value *map__next(Map map, int *i, void **p) {
   // *i is the bucket index.
   // *p is the List entry in that bucket.
   List entry = (List)(*p);
-  while (entry == NULL && *i < (map->buckets->count - 1)) {
+  int last = (int)map->buckets->count - 1;
+  while (entry == NULL && *i < last) {
     (*i)++;
     entry = *(List *)array__item_ptr(map->buckets, *i);
   }
-  if (entry == NULL && *i == (map->buckets->count - 1)) {
+  if (entry == NULL && *i == last) {
     *p = (void *)(1);  // A token non-NULL pointer to end the outer loops.
     return NULL;
   }
@@ -164,13 +173,13 @@ List *bucket_find(List *bucket, void *needle, map__Eq eq) {
 
 void double_size(Map map) {
   array__add_zeroed_items(map->buckets, map->buckets->count);
-  int n = map->buckets->count;
+  size_t n = map->buckets->count;
   array__for(List *, bucket, map->buckets, index) {
     List *entry = bucket;
     while (*entry) {
       map__key_value *pair = (*entry)->item;
       unsigned int h = map->hash(pair->key);
-      int bucket_index = h % n;
+      size_t bucket_index = h % n;
       if (bucket_index == index) {
         entry = &((*entry)->next);
         continue;
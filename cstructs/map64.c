@@ -0,0 +1,169 @@
+// map64.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// A plain buffer of 2^n bucket lists, where n grows to keep the average
+// load at most MAX_LOAD. Key x lives in the bucket given by the top n bits of
+// hash(x). When the table doubles, bucket i splits into buckets 2i and 2i + 1
+// according to the next hash bit, so the split can be done in place by
+// walking the old buckets from last to first.
+//
+
+#include "map64.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#define MIN_BUCKET_BITS 4
+#define MAX_LOAD 2.5
+
+
+// Internal functions.
+// ===================
+
+static size_t num_buckets(Map64 map) {
+  return (size_t)1 << map->bucket_bits;
+}
+
+static size_t bucket_index(Map64 map, uint64_t h) {
+  return (size_t)(h >> (64 - map->bucket_bits));
+}
+
+typedef struct {
+  void *  needle;
+  map__Eq eq;
+} needle_info;
+
+static int pair_matches_needle_info(void *p, void *i) {
+  map__key_value *pair = (map__key_value *)p;
+  needle_info *info = (needle_info *)i;
+  return info->eq(pair->key, info->needle);
+}
+
+static List *find_with_hash(Map64 map, void *needle, uint64_t h) {
+  needle_info info;
+  info.needle = needle;
+  info.eq = map->eq;
+  List *bucket = &map->buckets[bucket_index(map, h)];
+  return list__find_entry(bucket, &info, pair_matches_needle_info);
+}
+
+static void double_size(Map64 map) {
+  size_t old_n = num_buckets(map);
+  List *buckets = realloc(map->buckets, 2 * old_n * sizeof(List));
+  if (buckets == NULL) return;  // Keep going with longer chains.
+  map->buckets = buckets;
+  map->bucket_bits++;
+
+  // Moving from the end means each old bucket is read before it's overwritten.
+  for (size_t i = old_n; i-- > 0;) {
+    List old_bucket = buckets[i];
+    buckets[2 * i] = buckets[2 * i + 1] = NULL;
+    while (old_bucket) {
+      map__key_value *pair = old_bucket->item;
+      List *new_bucket = &buckets[bucket_index(map, map->hash(pair->key))];
+      list__move_first(&old_bucket, new_bucket);
+    }
+  }
+}
+
+static void release_and_free_pair(Map64 map, map__key_value *pair) {
+  if (map->key_releaser)   map->key_releaser  (pair->key,   NULL);
+  if (map->value_releaser) map->value_releaser(pair->value, NULL);
+  free(pair);
+}
+
+static void release_key_value_pair(void *pair, void *map) {
+  release_and_free_pair((Map64)map, (map__key_value *)pair);
+}
+
+
+// Public functions.
+// =================
+
+Map64 map64__new(map64__Hash hash, map__Eq eq) {
+  Map64 map = malloc(sizeof(Map64Struct));
+  map->count = 0;
+  map->bucket_bits = MIN_BUCKET_BITS;
+  map->buckets = calloc(num_buckets(map), sizeof(List));
+  map->hash = hash;
+  map->eq = eq;
+  map->key_releaser = NULL;
+  map->value_releaser = NULL;
+  map->pair_alloc = malloc;
+  return map;
+}
+
+void map64__delete(Map64 map) {
+  map64__clear(map);
+  free(map->buckets);
+  free(map);
+}
+
+map__key_value *map64__set(Map64 map, void *key, void *value) {
+  uint64_t h = map->hash(key);
+  List *entry = find_with_hash(map, key, h);
+  map__key_value *pair;
+  if (entry) {
+    pair = (*entry)->item;
+    if (map->key_releaser && pair->key != key) {
+      map->key_releaser(pair->key, NULL);
+    }
+    pair->key = key;
+    if (map->value_releaser && pair->value != value) {
+      map->value_releaser(pair->value, NULL);
+    }
+    pair->value = value;
+  } else {
+    // New pair.
+    pair = map->pair_alloc(sizeof(map__key_value));
+    pair->key = key;
+    pair->value = value;
+
+    if (map->count + 1 > MAX_LOAD * num_buckets(map)) double_size(map);
+
+    list__insert(&map->buckets[bucket_index(map, h)], pair);
+    map->count++;
+  }
+  return pair;
+}
+
+void map64__unset(Map64 map, void *key) {
+  List *entry = find_with_hash(map, key, map->hash(key));
+  if (entry == NULL) return;
+  release_and_free_pair(map, (*entry)->item);
+  list__remove_first(entry);
+  map->count--;
+}
+
+map__key_value *map64__get(Map64 map, void *needle) {
+  List *entry = find_with_hash(map, needle, map->hash(needle));
+  return entry ? (*entry)->item : NULL;
+}
+
+void map64__clear(Map64 map) {
+  size_t n = num_buckets(map);
+  for (size_t i = 0; i < n; ++i) {
+    list__delete_and_release(&map->buckets[i], release_key_value_pair, map);
+  }
+  map->count = 0;
+}
+
+map__key_value *map64__next(Map64 map, size_t *i, void **p) {
+  // *i is the bucket index; it starts at (size_t)-1.
+  // *p is the List entry in that bucket.
+  List entry = (List)(*p);
+  size_t n = num_buckets(map);
+  while (entry == NULL && *i + 1 < n) {
+    (*i)++;
+    entry = map->buckets[*i];
+  }
+  if (entry == NULL) {
+    *p = (void *)(1);  // A token non-NULL pointer to end the outer loops.
+    return NULL;
+  }
+  *p = (void *)entry->next;
+  return entry->item;
+}
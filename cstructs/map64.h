@@ -0,0 +1,53 @@
+// map64.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A variant of Map for tables with more than 2^31 entries.
+//
+// Map64 works like Map, except that counts are size_t values and hashes are
+// 64-bit. Buckets are chosen from the high bits of the hash, so the hash
+// function should mix well into all 64 bits.
+//
+
+#pragma once
+
+#include "list.h"
+#include "map.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint64_t ( *map64__Hash )(void *);
+
+typedef struct {
+  size_t      count;
+  List *      buckets;
+  int         bucket_bits;  // There are 2^bucket_bits buckets.
+  map64__Hash hash;
+  map__Eq     eq;
+  Releaser    key_releaser;
+  Releaser    value_releaser;
+  map__Alloc  pair_alloc;  // Default=malloc; customize to add fields per item.
+} Map64Struct;
+
+typedef Map64Struct *Map64;
+
+
+Map64            map64__new    (map64__Hash hash, map__Eq eq);
+void             map64__delete (Map64 map);
+
+map__key_value * map64__set    (Map64 map, void *key, void *value);
+void             map64__unset  (Map64 map, void *key);
+map__key_value * map64__get    (Map64 map, void *needle);
+
+void             map64__clear  (Map64 map);
+
+// This is for use with map64__for.
+map__key_value * map64__next   (Map64 map, size_t *i, void **p);
+
+// The variable var has type map__key_value *.
+#define map64__for(var, map) \
+  for (size_t __tmp_i = (size_t)-1; __tmp_i == (size_t)-1;) \
+  for (void * __tmp_p = NULL      ; __tmp_p == NULL      ;) \
+  for (map__key_value *var = map64__next(map, &__tmp_i, &__tmp_p); \
+       var; var = map64__next(map, &__tmp_i, &__tmp_p))
@@ -0,0 +1,452 @@
+// packedarray.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// A block's 128 values v[0..127] are coded as
+//
+//   delta[i] = v[i] - v[i - 4] - base,  where v[-4..-1] are first - base,
+//
+// all modulo 2^(8 * item_size), and base is the least v[i] - v[i - 4] for
+// i >= 4. Each delta takes bits bits. They're packed in the vertical layout
+// of SIMD-BP128: delta[4k + j] goes to lane j, the lanes are packed
+// independently into 32-bit words, and word w of lane j is at words[4w + j].
+// So one 16-byte load holds the same bits of four consecutive values, and
+// shifting and masking it unpacks all four. A block uses 4 * bits words.
+//
+// The deltas plus base are the block's steps of four, which must be below
+// 2^32 so that they can be summed as 32-bit lanes; a block of 8-byte values
+// with larger or negative steps is stored raw, as 256 words.
+//
+
+#include "packedarray.h"
+
+#include "internal.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define has_simd_decode
+#include <immintrin.h>
+#endif
+
+
+// Internal functions.
+// ===================
+
+#define block_size packedarray__block_size
+#define raw_bits   64
+
+typedef struct {
+  uint64_t first;
+  uint64_t last;
+  uint64_t offset;  // The index in words of the block's first word.
+  uint32_t base;
+  uint32_t bits;    // 0 to 32, or raw_bits.
+} Block;
+
+#define blocks_of(array) ((Block *)(array)->blocks.items)
+#define tail_of(array)   ((uint64_t *)(array)->tail.items)
+
+typedef void (*DecodeFunction)(const Block *block, const uint32_t *in,
+                               void *out);
+
+static int bit_width(uint32_t x) {
+  int bits = 0;
+  while (x) {
+    x >>= 1;
+    bits++;
+  }
+  return bits;
+}
+
+// Packs the 128 deltas into 4 * bits zeroed words.
+static void pack(uint32_t *out, const uint32_t *deltas, int bits) {
+  for (int j = 0; j < 4; ++j) {
+    for (int i = 0; i < 32; ++i) {
+      uint32_t delta = deltas[4 * i + j];
+      int bit = i * bits, w = bit / 32, shift = bit % 32;
+      out[4 * w + j] |= delta << shift;
+      if (shift + bits > 32) out[4 * (w + 1) + j] |= delta >> (32 - shift);
+    }
+  }
+}
+
+// Compresses block_size values into a new block. Returns 0, leaving the
+// array unchanged, if the memory can't be allocated.
+static int encode_block(PackedArray array, const uint64_t *values) {
+  uint64_t mask  = array->item_size == 4 ? UINT32_MAX : UINT64_MAX;
+  uint64_t first = values[0];
+  uint64_t base  = mask;
+  for (int i = 4; i < block_size; ++i) {
+    uint64_t step = (values[i] - values[i - 4]) & mask;
+    if (step < base) base = step;
+  }
+
+  uint32_t deltas[block_size], all_bits = 0;
+  int is_raw = (base > UINT32_MAX);
+  for (int i = 0; i < block_size && !is_raw; ++i) {
+    uint64_t prev = (i < 4) ? first - base : values[i - 4];
+    uint64_t step = (values[i] - prev) & mask;
+    is_raw        = (step > UINT32_MAX);
+    deltas[i]     = (uint32_t)(step - base);
+    all_bits     |= deltas[i];
+  }
+
+  int bits = is_raw ? raw_bits : bit_width(all_bits);
+  size_t num_words = is_raw ? 2 * block_size : 4 * (size_t)bits;
+  size_t offset    = array->words.count;
+  Block *block     = array__new_ptr(&array->blocks);
+  if (block == NULL) return 0;
+  uint32_t *out = num_words ? array__add_zeroed_items(&array->words, num_words)
+                            : NULL;
+  if (num_words && out == NULL) {
+    array->blocks.count--;
+    return 0;
+  }
+
+  block->first  = first;
+  block->last   = values[block_size - 1];
+  block->offset = offset;
+  block->base   = is_raw ? 0 : (uint32_t)base;
+  block->bits   = bits;
+  if (is_raw) {
+    memcpy(out, values, block_size * sizeof(uint64_t));
+  } else if (bits) {
+    pack(out, deltas, bits);
+  }
+  return 1;
+}
+
+static int flush_tail(PackedArray array) {
+  if (!encode_block(array, tail_of(array))) return 0;
+  array->tail.count = 0;
+  return 1;
+}
+
+// Scalar decoding.
+
+// Sets deltas[i] to delta[i] + base, which is v[i] - v[i - 4].
+static void unpack_scalar(const uint32_t *in, int bits, uint32_t base,
+                          uint32_t *deltas) {
+  uint32_t mask = (bits == 32) ? UINT32_MAX : (1u << bits) - 1;
+  for (int j = 0; j < 4; ++j) {
+    for (int i = 0; i < 32; ++i) {
+      int bit = i * bits, w = bit / 32, shift = bit % 32;
+      uint32_t delta = bits ? in[4 * w + j] >> shift : 0;
+      if (shift + bits > 32) delta |= in[4 * (w + 1) + j] << (32 - shift);
+      deltas[4 * i + j] = (delta & mask) + base;
+    }
+  }
+}
+
+static void decode_u32_scalar(const Block *block, const uint32_t *in,
+                              void *out) {
+  uint32_t steps[block_size], *values = (uint32_t *)out;
+  unpack_scalar(in, block->bits, block->base, steps);
+  uint32_t start = (uint32_t)(block->first - block->base);
+  for (int i = 0; i < block_size; ++i) {
+    values[i] = (i < 4 ? start : values[i - 4]) + steps[i];
+  }
+}
+
+static void decode_u64_scalar(const Block *block, const uint32_t *in,
+                              void *out) {
+  uint32_t steps[block_size];
+  uint64_t *values = (uint64_t *)out;
+  unpack_scalar(in, block->bits, block->base, steps);
+  uint64_t start = block->first - block->base;
+  for (int i = 0; i < block_size; ++i) {
+    values[i] = (i < 4 ? start : values[i - 4]) + steps[i];
+  }
+}
+
+#ifdef has_simd_decode
+
+// Sets steps[i] to the four lanes delta[4i .. 4i + 3] + base, unpacking four
+// values per shift.
+static always_inline __attribute__((target("sse2")))
+void unpack_sse2(const uint32_t *in, int bits, uint32_t base, __m128i *steps) {
+  const __m128i *words = (const __m128i *)in;
+  __m128i mask  = _mm_set1_epi32(bits == 32 ? -1 : (int)((1u << bits) - 1));
+  __m128i bases = _mm_set1_epi32((int)base);
+  __m128i word  = bits ? _mm_loadu_si128(words) : _mm_setzero_si128();
+  int shift = 0;
+  for (int i = 0; i < 32; ++i) {
+    __m128i delta = _mm_srl_epi32(word, _mm_cvtsi32_si128(shift));
+    shift += bits;
+    if (shift >= 32 && i < 31) {
+      // The next value starts in, or spills into, the next word.
+      shift -= 32;
+      word = _mm_loadu_si128(++words);
+      if (shift) {
+        delta = _mm_or_si128(delta, _mm_sll_epi32(word, _mm_cvtsi32_si128(
+                                                            bits - shift)));
+      }
+    }
+    steps[i] = _mm_add_epi32(_mm_and_si128(delta, mask), bases);
+  }
+}
+
+static __attribute__((noinline, target("sse2")))
+void decode_u32_sse2(const Block *block, const uint32_t *in, void *out) {
+  __m128i steps[32], *values = (__m128i *)out;
+  unpack_sse2(in, block->bits, block->base, steps);
+  __m128i sum = _mm_set1_epi32((int)(uint32_t)(block->first - block->base));
+  for (int i = 0; i < 32; ++i) {
+    sum = _mm_add_epi32(sum, steps[i]);
+    _mm_storeu_si128(values + i, sum);
+  }
+}
+
+static __attribute__((noinline, target("sse2")))
+void decode_u64_sse2(const Block *block, const uint32_t *in, void *out) {
+  __m128i steps[32], *values = (__m128i *)out;
+  unpack_sse2(in, block->bits, block->base, steps);
+  __m128i lo   = _mm_set1_epi64x((long long)(block->first - block->base));
+  __m128i hi   = lo;
+  __m128i zero = _mm_setzero_si128();
+  for (int i = 0; i < 32; ++i) {
+    lo = _mm_add_epi64(lo, _mm_unpacklo_epi32(steps[i], zero));
+    hi = _mm_add_epi64(hi, _mm_unpackhi_epi32(steps[i], zero));
+    _mm_storeu_si128(values + 2 * i,     lo);
+    _mm_storeu_si128(values + 2 * i + 1, hi);
+  }
+}
+
+static __attribute__((noinline, target("avx2")))
+void decode_u64_avx2(const Block *block, const uint32_t *in, void *out) {
+  __m128i steps[32];
+  __m256i *values = (__m256i *)out;
+  unpack_sse2(in, block->bits, block->base, steps);
+  __m256i sum = _mm256_set1_epi64x((long long)(block->first - block->base));
+  for (int i = 0; i < 32; ++i) {
+    sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(steps[i]));
+    _mm256_storeu_si256(values + i, sum);
+  }
+}
+
+#endif  // has_simd_decode
+
+// The decoders in use for 4- and 8-byte items. They're chosen once, by
+// packedarray__use_simd, so that decoding a block doesn't check the CPU.
+static DecodeFunction decode_u32 = decode_u32_scalar;
+static DecodeFunction decode_u64 = decode_u64_scalar;
+
+#ifdef has_simd_decode
+// Picks the SIMD decoders as the program loads, before any thread can use a
+// packed array.
+static __attribute__((constructor)) void choose_decoders() {
+  __builtin_cpu_init();
+  packedarray__use_simd(1);
+}
+#endif
+
+static DecodeFunction decoder(size_t item_size) {
+  return item_size == 4 ? decode_u32 : decode_u64;
+}
+
+// Writes the values of block b as item_size-byte integers; b may be the
+// tail. Returns the number of values.
+static size_t decode(PackedArray array, size_t b, DecodeFunction decode_fn,
+                     void *out) {
+  if (b >= array->blocks.count) {
+    uint64_t *tail = tail_of(array);
+    size_t n = array->tail.count;
+    if (array->item_size == 8) {
+      memcpy(out, tail, n * sizeof(uint64_t));
+    } else {
+      for (size_t i = 0; i < n; ++i) ((uint32_t *)out)[i] = (uint32_t)tail[i];
+    }
+    return n;
+  }
+  Block *block = blocks_of(array) + b;
+  const uint32_t *in = (const uint32_t *)array->words.items + block->offset;
+  if (block->bits == raw_bits) {
+    memcpy(out, in, block_size * sizeof(uint64_t));
+  } else {
+    decode_fn(block, in, out);
+  }
+  return block_size;
+}
+
+// Writes the values of block b, which may be the tail, as uint64_t values.
+static size_t decode_wide(PackedArray array, size_t b, uint64_t *values) {
+  if (array->item_size == 8) {
+    return decode(array, b, decoder(8), values);
+  }
+  uint32_t narrow[block_size];
+  size_t n = decode(array, b, decoder(4), narrow);
+  for (size_t i = 0; i < n; ++i) values[i] = narrow[i];
+  return n;
+}
+
+
+// Public functions.
+// =================
+
+PackedArray packedarray__new(size_t item_size) {
+  PackedArray array = malloc(sizeof(PackedArrayStruct));
+  if (array == NULL) return NULL;
+  if (packedarray__init(array, item_size) == NULL) {
+    free(array);
+    return NULL;
+  }
+  return array;
+}
+
+PackedArray packedarray__init(PackedArray array, size_t item_size) {
+  if (item_size != 4 && item_size != 8) return NULL;
+  if (array__init(&array->blocks, 0, sizeof(Block)) == NULL) return NULL;
+  if (array__init(&array->words, 0, sizeof(uint32_t)) == NULL ||
+      array__init(&array->tail, block_size, sizeof(uint64_t)) == NULL) {
+    array__release(&array->blocks);
+    array__release(&array->words);
+    return NULL;
+  }
+  array->count     = 0;
+  array->item_size = item_size;
+  return array;
+}
+
+void packedarray__release(void *array) {
+  PackedArray a = (PackedArray)array;
+  array__release(&a->blocks);
+  array__release(&a->words);
+  array__release(&a->tail);
+  a->count = 0;
+}
+
+void packedarray__release_with_context(void *array, void *context) {
+  packedarray__release(array);
+}
+
+void packedarray__delete(PackedArray array) {
+  packedarray__release(array);
+  free(array);
+}
+
+void packedarray__use_simd(int use_simd) {
+  decode_u32 = decode_u32_scalar;
+  decode_u64 = decode_u64_scalar;
+#ifdef has_simd_decode
+  if (use_simd && __builtin_cpu_supports("sse2")) {
+    decode_u32 = decode_u32_sse2;
+    decode_u64 = decode_u64_sse2;
+  }
+  if (use_simd && __builtin_cpu_supports("avx2")) decode_u64 = decode_u64_avx2;
+#endif
+}
+
+int packedarray__add(PackedArray array, uint64_t value) {
+  if (array->tail.count == block_size && !flush_tail(array)) return 0;
+  array__add_item_val(&array->tail, value);
+  array->count++;
+  // If this fails, the full tail is flushed by the next add instead.
+  if (array->tail.count == block_size) flush_tail(array);
+  return 1;
+}
+
+void packedarray__shrink_to_fit(PackedArray array) {
+  array__shrink_to_fit(&array->blocks);
+  array__shrink_to_fit(&array->words);
+}
+
+size_t packedarray__bytes(PackedArray array) {
+  return array->blocks.capacity * sizeof(Block) +
+         array->words.capacity  * sizeof(uint32_t) +
+         array->tail.capacity   * sizeof(uint64_t);
+}
+
+uint64_t packedarray__get(PackedArray array, size_t index) {
+  size_t b = index / block_size;
+  if (b >= array->blocks.count) {
+    return tail_of(array)[index - b * block_size];
+  }
+  uint64_t values[block_size];
+  decode_wide(array, b, values);
+  return values[index % block_size];
+}
+
+size_t packedarray__find(PackedArray array, uint64_t value) {
+  // Find the first block whose last value is at least value; if there's
+  // none, it's in the tail, if anywhere.
+  Block *blocks = blocks_of(array);
+  size_t lo = 0, hi = array->blocks.count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (blocks[mid].last < value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  uint64_t values[block_size];
+  size_t n = decode_wide(array, lo, values), i = 0, j = n;
+  while (i < j) {
+    size_t mid = i + (j - i) / 2;
+    if (values[mid] < value) {
+      i = mid + 1;
+    } else {
+      j = mid;
+    }
+  }
+  return lo * block_size + i;
+}
+
+PackedArray packedarray__from_array(Array values) {
+  PackedArray array = packedarray__new(values->item_size);
+  if (array == NULL) return NULL;
+  for (size_t i = 0; i < values->count; ++i) {
+    char *item = array__item_ptr(values, i);
+    uint64_t value = (values->item_size == 4) ? *(uint32_t *)item
+                                              : *(uint64_t *)item;
+    if (!packedarray__add(array, value)) {
+      packedarray__delete(array);
+      return NULL;
+    }
+  }
+  packedarray__shrink_to_fit(array);
+  return array;
+}
+
+int packedarray__to_array(PackedArray array, Array out) {
+  if (out->item_size != array->item_size ||
+      array->count > SIZE_MAX - out->count ||
+      !array__reserve(out, out->count + array->count)) {
+    return 0;
+  }
+  DecodeFunction decode_fn = decoder(array->item_size);
+  size_t num_blocks = packedarray__num_blocks(array);
+  for (size_t b = 0; b < num_blocks; ++b) {
+    void *items = out->items + out->count * out->item_size;
+    out->count += decode(array, b, decode_fn, items);
+  }
+  return 1;
+}
+
+size_t packedarray__decode_block(PackedArray array, size_t block,
+                                 void *values) {
+  return decode(array, block, decoder(array->item_size), values);
+}
+
+uint64_t packedarray__start(packedarray__Cursor *cursor, PackedArray array,
+                            size_t index) {
+  cursor->array      = array;
+  cursor->index      = index;
+  cursor->num_values = 0;
+  return packedarray__refill(cursor);
+}
+
+uint64_t packedarray__refill(packedarray__Cursor *cursor) {
+  PackedArray array = cursor->array;
+  if (cursor->index >= array->count) return 0;
+  size_t b = cursor->index / block_size;
+  cursor->pos        = cursor->index - b * block_size;
+  cursor->num_values = decode_wide(array, b, cursor->values);
+  return cursor->values[cursor->pos];
+}
@@ -0,0 +1,125 @@
+// packedarray.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A compressed sequence of 4- or 8-byte unsigned integers, meant for sorted
+// ids and posting lists that would take billions of items as a plain Array.
+//
+// Values are kept in blocks of packedarray__block_size. Within a block, each
+// value is stored as its difference from the value four places before it,
+// minus the block's smallest such difference, packed into just enough bits
+// for the largest; this is the SIMD-BP128 layout of Lemire and Boytsov's
+// "Decoding billions of integers per second through vectorization". Four
+// values decode at once with SSE2, and the running sums are done four lanes
+// at a time too. Each block also records its first and last values, so
+// packedarray__find can skip straight to the one block it needs.
+//
+// Any sequence can be stored, but it only shrinks if it mostly rises by
+// small steps: sorted ids with gaps under 16 take about a byte each. A block
+// of 8-byte values whose differences don't fit in 32 bits is stored as is.
+//
+// Values are appended; the last, partly filled block is kept uncompressed
+// until it fills up. As with Array, a packed array may be nested in another
+// structure with packedarray__init and packedarray__release.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define packedarray__block_size 128
+
+typedef struct {
+  size_t      count;
+  size_t      item_size;  // 4 or 8.
+  ArrayStruct blocks;     // Headers of the compressed blocks.
+  ArrayStruct words;      // The packed uint32_t words of every block.
+  ArrayStruct tail;       // The uint64_t values after the last block.
+} PackedArrayStruct;
+
+typedef PackedArrayStruct *PackedArray;
+
+// These return NULL if item_size isn't 4 or 8, or the memory can't be
+// allocated.
+PackedArray packedarray__new     (size_t item_size);
+PackedArray packedarray__init    (PackedArray array, size_t item_size);
+void        packedarray__release (void *array);  // Frees all but array.
+void        packedarray__delete  (PackedArray array);
+
+void packedarray__release_with_context(void *array, void *context);
+
+// Chooses whether blocks are decoded with SIMD instructions, when the CPU has
+// them, or in plain C. SIMD is used by default; both give the same values, so
+// this is mainly for testing. Don't call it while another thread is reading a
+// packed array.
+void packedarray__use_simd(int use_simd);
+
+// Appends value, which must fit in item_size bytes. Returns 0, leaving the
+// array unchanged, if the memory can't be allocated.
+int    packedarray__add        (PackedArray array, uint64_t value);
+
+// Frees unused capacity; useful once an array is complete.
+void   packedarray__shrink_to_fit(PackedArray array);
+
+// The bytes of memory held, including unused capacity.
+size_t packedarray__bytes      (PackedArray array);
+
+// Returns the value at index in O(packedarray__block_size) time.
+uint64_t packedarray__get      (PackedArray array, size_t index);
+
+// For an array in ascending order, returns the index of the first value that
+// is at least value, or count if there's none. It binary searches the block
+// headers and decodes only the one block the value could be in.
+size_t packedarray__find       (PackedArray array, uint64_t value);
+
+// Conversion from and to plain Arrays of items of the same size. The new
+// array has no unused capacity. to_array appends every value to out, and
+// returns 0, leaving out unchanged, if it can't make room.
+PackedArray packedarray__from_array (Array values);
+int         packedarray__to_array   (PackedArray array, Array out);
+
+// Block access, the fastest way to scan. Block i holds the values from index
+// i * packedarray__block_size; decode_block writes them as item_size-byte
+// integers to values, which has room for packedarray__block_size of them,
+// and returns how many there are.
+#define packedarray__num_blocks(array) \
+  (((array)->count + packedarray__block_size - 1) / packedarray__block_size)
+size_t packedarray__decode_block(PackedArray array, size_t block,
+                                 void *values);
+
+// Sequential iteration, a block at a time. Example:
+//
+//   packedarray__Cursor cursor;
+//   packedarray__for(array, &cursor, value) { /* value is a uint64_t */ }
+//
+// Or, to start from an index:
+//
+//   uint64_t value = packedarray__start(&cursor, array, index);
+//   for (; cursor.index < array->count; value = packedarray__next(&cursor))
+//
+// The array mustn't change during the loop.
+
+typedef struct {
+  PackedArray array;
+  size_t      index;       // The index of the current value.
+  size_t      pos;         // The index of the current value within values.
+  size_t      num_values;
+  uint64_t    values[packedarray__block_size];
+} packedarray__Cursor;
+
+uint64_t packedarray__start (packedarray__Cursor *cursor, PackedArray array,
+                             size_t index);
+uint64_t packedarray__refill(packedarray__Cursor *cursor);
+
+#define packedarray__next(cursor)                              \
+  (++(cursor)->index, ++(cursor)->pos < (cursor)->num_values   \
+                          ? (cursor)->values[(cursor)->pos]     \
+                          : packedarray__refill(cursor))
+
+#define packedarray__for(array, cursor, value)                  \
+  for (uint64_t value = packedarray__start(cursor, array, 0);   \
+       (cursor)->index < (array)->count;                        \
+       value = packedarray__next(cursor))
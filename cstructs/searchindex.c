@@ -0,0 +1,83 @@
+// searchindex.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "searchindex.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+// Keys are 8 bytes, so a 64-byte cache line holds 8 of them, and the 16
+// descendants of position k four levels down start at position 16k.
+#define PREFETCH_DISTANCE 16
+
+#if defined(__GNUC__)
+#define prefetch(ptr) __builtin_prefetch(ptr)
+#else
+#define prefetch(ptr)
+#endif
+
+
+// Internal functions.
+// ===================
+
+// Fills the subtree rooted at position k with the items from index i onward,
+// in order; returns the index of the next unused item.
+static size_t fill(SearchIndex index, Array array, size_t key_offset,
+                   size_t i, size_t k) {
+  if (k > index->count) return i;
+  i = fill(index, array, key_offset, i, 2 * k);
+  char *key = (char *)array__item_ptr(array, i) + key_offset;
+  index->keys[k]    = array__ordered_key(key, index->key_type);
+  index->indexes[k] = i;
+  return fill(index, array, key_offset, i + 1, 2 * k + 1);
+}
+
+// Returns the number of trailing one bits in k.
+static int trailing_ones(size_t k) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(~(unsigned long long)k);
+#else
+  int n = 0;
+  for (; k & 1; k >>= 1) ++n;
+  return n;
+#endif
+}
+
+
+// Public functions.
+// =================
+
+SearchIndex searchindex__new(Array sorted_array,
+                             size_t key_offset,
+                             array__KeyType key_type) {
+  SearchIndex index = malloc(sizeof(SearchIndexStruct));
+  index->count    = sorted_array->count;
+  index->key_type = key_type;
+  index->keys     = malloc((index->count + 1) * sizeof(uint64_t));
+  index->indexes  = malloc((index->count + 1) * sizeof(size_t));
+  fill(index, sorted_array, key_offset, 0, 1);  // 0, 1 --> item, position
+  return index;
+}
+
+void searchindex__delete(SearchIndex index) {
+  free(index->keys);
+  free(index->indexes);
+  free(index);
+}
+
+size_t searchindex__lower_bound(SearchIndex index, const void *key) {
+  uint64_t target = array__ordered_key(key, index->key_type);
+  uint64_t *keys = index->keys;
+  size_t k = 1;
+  while (k <= index->count) {
+    prefetch(keys + PREFETCH_DISTANCE * k);
+    k = 2 * k + (keys[k] < target);
+  }
+  // The path went left at the answer, then only right; undo the right turns
+  // and the final left turn. If the path only went right, k is now 0.
+  k >>= trailing_ones(k) + 1;
+  return k ? index->indexes[k] : index->count;
+}
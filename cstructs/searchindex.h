@@ -0,0 +1,43 @@
+// searchindex.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A read-only search index over an Array sorted by a numeric key.
+//
+// The keys are copied out in Eytzinger order: the layout of an implicit
+// binary search tree stored breadth-first, with the root at position 1 and
+// the children of position k at 2k and 2k + 1. The first few levels of the
+// tree share a handful of cache lines, and a search can prefetch the lines it
+// will need several levels ahead. This makes lookups in large tables much
+// faster than a binary search over the Array itself.
+//
+// The index does not track later changes to the Array.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+  size_t         count;
+  array__KeyType key_type;
+  uint64_t *     keys;     // keys[1..count]; see array__ordered_key.
+  size_t *       indexes;  // indexes[k] is the Array index of keys[k].
+} SearchIndexStruct;
+
+typedef SearchIndexStruct *SearchIndex;
+
+// The array is expected to be sorted by the given key, e.g. by
+// array__sort_by_key.
+SearchIndex searchindex__new    (Array sorted_array,
+                                 size_t key_offset,
+                                 array__KeyType key_type);
+void        searchindex__delete (SearchIndex index);
+
+// Returns the Array index of the first item whose key is not less than *key,
+// or the Array's count if there's no such item; key points to a value of the
+// index's key type.
+size_t      searchindex__lower_bound (SearchIndex index, const void *key);
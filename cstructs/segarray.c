@@ -0,0 +1,97 @@
+// segarray.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// Segment k holds 2 ^ (first_bits + k) items, so the items before segment k
+// number 2 ^ (first_bits + k) - 2 ^ first_bits. Adding 2 ^ first_bits to an
+// index therefore puts its highest set bit at first_bits + k, where k is the
+// index's segment, and the bits below that are its offset in the segment.
+//
+
+#include "segarray.h"
+
+#include "internal.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+
+// Internal functions.
+// ===================
+
+// Allocates the next segment; returns 0 on failure.
+static int add_segment(SegArray seg_array) {
+  int k = seg_array->num_segments;
+  int bits = seg_array->first_bits + k;
+  if (k == segarray__max_segments || bits >= 64) return 0;
+  size_t num_items = (size_t)1 << bits;
+  if (num_items > SIZE_MAX / seg_array->item_size) return 0;
+  char *segment = malloc(num_items * seg_array->item_size);
+  if (segment == NULL) return 0;
+  seg_array->segments[k] = segment;
+  seg_array->num_segments++;
+  return 1;
+}
+
+
+// Public functions.
+// =================
+
+SegArray segarray__new(size_t first_capacity, size_t item_size) {
+  SegArray seg_array = malloc(sizeof(SegArrayStruct));
+  if (seg_array == NULL) return NULL;
+  seg_array->count        = 0;
+  seg_array->item_size    = item_size ? item_size : 1;
+  seg_array->releaser     = NULL;
+  seg_array->first_bits   = 0;
+  seg_array->num_segments = 0;
+  while (seg_array->first_bits < 62 &&
+         ((size_t)1 << seg_array->first_bits) < first_capacity) {
+    seg_array->first_bits++;
+  }
+  return seg_array;
+}
+
+void segarray__delete(SegArray seg_array) {
+  segarray__clear(seg_array);
+  for (int k = 0; k < seg_array->num_segments; ++k) {
+    free(seg_array->segments[k]);
+  }
+  free(seg_array);
+}
+
+void segarray__clear(SegArray seg_array) {
+  if (seg_array->releaser) {
+    segarray__for(void *, item, seg_array, i) {
+      seg_array->releaser(item, NULL);
+    }
+  }
+  seg_array->count = 0;
+}
+
+void *segarray__item_ptr(SegArray seg_array, size_t index) {
+  size_t offset;
+  int k = segment_of(seg_array->first_bits, index, &offset);
+  // Past the last segment, as at the end of a segarray__for loop.
+  if (k >= seg_array->num_segments) return NULL;
+  return seg_array->segments[k] + offset * seg_array->item_size;
+}
+
+void *segarray__new_ptr(SegArray seg_array) {
+  size_t offset;
+  int k = segment_of(seg_array->first_bits, seg_array->count, &offset);
+  if (k == seg_array->num_segments && !add_segment(seg_array)) return NULL;
+  seg_array->count++;
+  return seg_array->segments[k] + offset * seg_array->item_size;
+}
+
+void *segarray__add_item_ptr(SegArray seg_array, void *item) {
+  void *new_item = segarray__new_ptr(seg_array);
+  if (new_item) memcpy(new_item, item, seg_array->item_size);
+  return new_item;
+}
@@ -0,0 +1,65 @@
+// segarray.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// A segmented array: a sequence of fixed-size items whose addresses never
+// change as the sequence grows.
+//
+// Items live in a list of segments. Segment 0 holds first_capacity items,
+// rounded up to a power of two, and each later segment is twice the size of
+// the one before, so there are never more than 64 segments. Growth allocates
+// a new segment and never moves existing items, so pointers from
+// segarray__item_ptr and segarray__new_ptr stay valid until the items are
+// cleared. Finding an item's segment takes a single bit scan of its index.
+//
+// Unlike Array, the items are not all contiguous, so a SegArray can't be
+// passed to array__ functions.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdlib.h>
+
+#define segarray__max_segments 64
+
+typedef struct {
+  size_t   count;
+  size_t   item_size;
+  Releaser releaser;
+  int      first_bits;    // Segment 0 holds 2 ^ first_bits items.
+  int      num_segments;  // The number of allocated segments.
+  char *   segments[segarray__max_segments];
+} SegArrayStruct;
+
+typedef SegArrayStruct *SegArray;
+
+// Returns NULL if the memory can't be allocated. No segments are allocated
+// until the first item is added.
+SegArray segarray__new    (size_t first_capacity, size_t item_size);
+void     segarray__delete (SegArray seg_array);
+
+// Releases all items and sets the count to 0; the segments are kept for
+// reuse.
+void     segarray__clear  (SegArray seg_array);
+
+void *   segarray__item_ptr(SegArray seg_array, size_t index);
+#define  segarray__item_val(seg_array, i, type) \
+  (*(type *)segarray__item_ptr(seg_array, i))
+
+// These return a pointer to the new item, or NULL if the segment it needs
+// can't be allocated.
+void *   segarray__new_ptr      (SegArray seg_array);
+void *   segarray__add_item_ptr (SegArray seg_array, void *item);
+#define  segarray__new_val(a, type) (*(type *)segarray__new_ptr(a))
+#define  segarray__add_item_val(a, i) segarray__add_item_ptr(a, &i)
+
+// Loop over a segmented array.
+// Example: segarray__for(item_type *, item_ptr, seg_array, index) { ... }
+// Additions don't invalidate item_ptr.
+#define segarray__for(type, item_ptr, seg_array, index)              \
+  for (size_t index = 0, __tmpvar = 1; __tmpvar--;)                  \
+  for (type item_ptr = (type)segarray__item_ptr(seg_array, index);   \
+       index < (seg_array)->count;                                   \
+       item_ptr = (type)segarray__item_ptr(seg_array, ++index))
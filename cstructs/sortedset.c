@@ -0,0 +1,468 @@
+// sortedset.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Internal structure:
+// The two-input operations share one loop. It compares the items under a
+// cursor into each input, then gallops the cursor on the lesser item forward
+// past every item less than the greater one, copying the items it passes
+// when the operation keeps them. A gallop probes 1, 2, 4, ... items ahead
+// before a binary search, so a cursor that moves by one costs one compare.
+// The n-way merge keeps a cursor per input in a Heap, and copies from the
+// least cursor's input up to the next least cursor's item in one gallop.
+//
+// The block kernels used by the keyed intersect and difference follow
+// Schlegel, Willhalm and Lehner's SIMD intersection: compare a block of keys
+// from a against a block from b in every rotation, OR the results into a mask
+// of the a keys that matched, then move past whichever block has the smaller
+// last key, or past a's block on a tie. A key of a can only equal keys of b
+// in blocks it meets this way, so a's mask is final when its block is passed.
+//
+
+#include "sortedset.h"
+
+#include "heap.h"
+#include "internal.h"
+
+#ifdef DEBUG
+#include "memprofile.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+// Inputs more than this many times larger than the other input are galloped
+// over rather than scanned by the block kernels.
+#define GALLOP_RATIO 32
+
+
+// Internal types.
+// ===============
+
+typedef enum {
+  op_intersect,
+  op_union,
+  op_difference
+} SetOp;
+
+typedef struct {
+  array__CompareFunction compare;
+  void *                 context;
+  size_t                 item_size;
+} Order;
+
+typedef struct {
+  size_t         key_offset;
+  array__KeyType type;
+} KeyInfo;
+
+// The position of an n-way merge within one of its inputs.
+typedef struct {
+  size_t index;
+  int    array;
+} Cursor;
+
+typedef struct {
+  Array *arrays;
+  Order *order;
+} MergeInfo;
+
+
+// Internal functions.
+// ===================
+
+static int compare(Order *order, const char *x, const char *y) {
+  if (order->compare) return order->compare(order->context, x, y);
+  return memcmp(x, y, order->item_size);
+}
+
+static int compare_keys(void *context, const void *x, const void *y) {
+  KeyInfo *info = (KeyInfo *)context;
+  uint64_t key_x = array__ordered_key((const char *)x + info->key_offset,
+                                      info->type);
+  uint64_t key_y = array__ordered_key((const char *)y + info->key_offset,
+                                      info->type);
+  return (key_x > key_y) - (key_x < key_y);
+}
+
+static int is_before(Order *order, const char *item, const char *key,
+                     int past_equal) {
+  int c = compare(order, item, key);
+  return c < 0 || (c == 0 && past_equal);
+}
+
+// Returns the first index from lo to n whose item is not less than key, or,
+// if past_equal is set, is greater than key; returns n if there's none.
+static size_t gallop(Order *order, const char *items, size_t lo, size_t n,
+                     const char *key, int past_equal) {
+  size_t size = order->item_size, step = 1, probe = lo, hi = n;
+  while (probe < n) {
+    if (!is_before(order, items + probe * size, key, past_equal)) {
+      hi = probe;
+      break;
+    }
+    lo    = probe + 1;
+    probe = (n - lo > step) ? lo + step : n;
+    step *= 2;
+  }
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (is_before(order, items + mid * size, key, past_equal)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Makes room for max_new more items in out and returns where they go, or
+// returns NULL if out can't grow.
+static char *reserve(Array out, size_t max_new) {
+  if (max_new > SIZE_MAX - out->count) return NULL;
+  if (!array__reserve(out, out->count + max_new)) return NULL;
+  return (char *)array__item_ptr(out, out->count);
+}
+
+static char *emit(char *dst, const char *items, size_t n, size_t size) {
+  memcpy(dst, items, n * size);
+  return dst + n * size;
+}
+
+static void finish(Array out, char *end) {
+  out->count = (size_t)(end - out->items) / out->item_size;
+}
+
+static int merge_two(Array out, Array a, Array b, Order *order, SetOp op) {
+  size_t na = a->count, nb = b->count, size = order->item_size;
+  if (op == op_union && nb > SIZE_MAX - na) return 0;
+  // Intersect keeps every copy in a of an item found in b, so it may keep
+  // all of a even when b is shorter.
+  size_t max_new = (op == op_union) ? na + nb : na;
+  char *dst = reserve(out, max_new);
+  if (dst == NULL) return 0;
+
+  const char *x = a->items, *y = b->items;
+  size_t i = 0, j = 0;
+  while (i < na && j < nb) {
+    int c = compare(order, x + i * size, y + j * size);
+    if (c < 0) {
+      size_t end = gallop(order, x, i + 1, na, y + j * size, 0);
+      if (op != op_intersect) dst = emit(dst, x + i * size, end - i, size);
+      i = end;
+    } else if (c > 0) {
+      size_t end = gallop(order, y, j + 1, nb, x + i * size, 0);
+      if (op == op_union) dst = emit(dst, y + j * size, end - j, size);
+      j = end;
+    } else if (op == op_intersect) {
+      dst = emit(dst, x + i++ * size, 1, size);
+    } else if (op == op_difference) {
+      i++;
+    } else {
+      j++;  // The union keeps a's copy of this item.
+    }
+  }
+  if (op != op_intersect) dst = emit(dst, x + i * size, na - i, size);
+  if (op == op_union)     dst = emit(dst, y + j * size, nb - j, size);
+  finish(out, dst);
+  return 1;
+}
+
+static const char *cursor_item(MergeInfo *info, const Cursor *cursor) {
+  Array array = info->arrays[cursor->array];
+  return array->items + cursor->index * array->item_size;
+}
+
+// Orders cursors by their items, then by input, which keeps the merge stable.
+static int compare_cursors(void *context, const void *x, const void *y) {
+  MergeInfo *info = (MergeInfo *)context;
+  const Cursor *cx = (const Cursor *)x, *cy = (const Cursor *)y;
+  int c = compare(info->order, cursor_item(info, cx), cursor_item(info, cy));
+  if (c) return c;
+  return (cx->array > cy->array) - (cx->array < cy->array);
+}
+
+static int merge_many(Array out, Array *arrays, int num_arrays,
+                      Order *order) {
+  size_t total = 0;
+  for (int k = 0; k < num_arrays; ++k) {
+    if (arrays[k]->count > SIZE_MAX - total) return 0;
+    total += arrays[k]->count;
+  }
+  char *dst = reserve(out, total);
+  if (dst == NULL) return 0;
+
+  MergeInfo info = { arrays, order };
+  Heap heap = heap__new(sizeof(Cursor), 4, compare_cursors, &info);
+  if (heap == NULL) return 0;
+  for (int k = 0; k < num_arrays; ++k) {
+    Cursor cursor = { 0, k };
+    if (arrays[k]->count && !heap__push_val(heap, cursor)) {
+      heap__delete(heap);
+      return 0;
+    }
+  }
+
+  // Copy from the least input until its items pass the next least cursor's
+  // item; equal items go first only if they're from an earlier input. A
+  // cursor is pushed back only after one is popped, so the heap never grows.
+  Cursor cursor;
+  while (heap__pop(heap, &cursor)) {
+    Array array = arrays[cursor.array];
+    Cursor *next = heap__top(heap);
+    size_t end = array->count;
+    if (next) {
+      end = gallop(order, array->items, cursor.index + 1, end,
+                   cursor_item(&info, next), cursor.array < next->array);
+    }
+    dst = emit(dst, array->items + cursor.index * order->item_size,
+               end - cursor.index, order->item_size);
+    if (end < array->count) {
+      cursor.index = end;
+      heap__push_val(heap, cursor);
+    }
+  }
+  heap__delete(heap);
+  finish(out, dst);
+  return 1;
+}
+
+
+// Block kernels.
+// ==============
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define has_block_kernels
+#endif
+
+typedef size_t (*MatchFunction)(const char *a, size_t na,
+                                const char *b, size_t nb,
+                                uint64_t flip, int keep, char *out);
+
+static always_inline uint64_t load_key(const char *key, size_t width) {
+  if (width == 4) {
+    uint32_t u32;
+    memcpy(&u32, key, 4);
+    return u32;
+  }
+  uint64_t u64;
+  memcpy(&u64, key, 8);
+  return u64;
+}
+
+// Copies the keys of a whose bits are set in mask to out, and returns how
+// many there were.
+static always_inline size_t emit_masked(char *out, const char *a,
+                                        unsigned mask, size_t width) {
+  size_t n = 0;
+  for (; mask; mask &= mask - 1, ++n) {
+    memcpy(out + n * width, a + __builtin_ctz(mask) * width, width);
+  }
+  return n;
+}
+
+// Finishes a match with a scalar merge. Bits set in matched mark keys of a
+// that are already known to have matches in b.
+static always_inline size_t match_tail(const char *a, size_t na,
+                                       const char *b, size_t nb,
+                                       uint64_t flip, int keep,
+                                       unsigned matched, char *out,
+                                       size_t width) {
+  size_t n = 0, j = 0;
+  for (size_t i = 0; i < na; ++i) {
+    uint64_t key = load_key(a + i * width, width) ^ flip;
+    while (j < nb && (load_key(b + j * width, width) ^ flip) < key) ++j;
+    int is_match = (i < 32 && ((matched >> i) & 1)) ||
+                   (j < nb && (load_key(b + j * width, width) ^ flip) == key);
+    if (is_match == keep) memcpy(out + n++ * width, a + i * width, width);
+  }
+  return n;
+}
+
+#ifdef has_block_kernels
+
+#include <immintrin.h>
+
+#define sse2_bytes 16
+#define avx2_bytes 32
+
+// These return a bit mask of the keys in a's block that equal some key in
+// b's block. SSE2 has no 64-bit compare, so 8-byte keys match when both of
+// their 32-bit halves do.
+static always_inline __attribute__((target("sse2")))
+unsigned block_mask_sse2(const char *a, const char *b, size_t width) {
+  __m128i va = _mm_loadu_si128((const __m128i *)a);
+  __m128i vb = _mm_loadu_si128((const __m128i *)b);
+  if (width == 4) {
+    __m128i eq = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39))),
+        _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4e)),
+                     _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93))));
+    return (unsigned)_mm_movemask_ps(_mm_castsi128_ps(eq));
+  }
+  __m128i eq0 = _mm_cmpeq_epi32(va, vb);
+  __m128i eq1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4e));
+  eq0 = _mm_and_si128(eq0, _mm_shuffle_epi32(eq0, 0xb1));
+  eq1 = _mm_and_si128(eq1, _mm_shuffle_epi32(eq1, 0xb1));
+  return (unsigned)_mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(eq0, eq1)));
+}
+
+// For 4-byte keys, the in-lane rotations meet the keys in the same 128-bit
+// half, and the same rotations after swapping halves meet the rest.
+static always_inline __attribute__((target("avx2")))
+unsigned block_mask_avx2(const char *a, const char *b, size_t width) {
+  __m256i va = _mm256_loadu_si256((const __m256i *)a);
+  __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+  __m256i eq;
+  if (width == 4) {
+    __m256i vs = _mm256_permute2x128_si256(vb, vb, 0x01);
+    eq = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi32(va, vb),
+                _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vb, 0x39))),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vb, 0x4e)),
+                _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vb, 0x93)))),
+        _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi32(va, vs),
+                _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vs, 0x39))),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vs, 0x4e)),
+                _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vs, 0x93)))));
+    return (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(eq));
+  }
+  eq = _mm256_or_si256(
+      _mm256_or_si256(
+          _mm256_cmpeq_epi64(va, vb),
+          _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x39))),
+      _mm256_or_si256(
+          _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x4e)),
+          _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x93))));
+  return (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(eq));
+}
+
+#define define_matcher(isa, target_isa, width)                              \
+  static __attribute__((noinline, target(target_isa)))                     \
+  size_t match_##isa##_##width(const char *a, size_t na,                   \
+                               const char *b, size_t nb,                   \
+                               uint64_t flip, int keep, char *out) {       \
+    size_t block = isa##_bytes / width, i = 0, j = 0, n = 0;               \
+    unsigned matched = 0, all = (1u << block) - 1;                         \
+    while (i + block <= na && j + block <= nb) {                           \
+      matched |= block_mask_##isa(a + i * width, b + j * width, width);    \
+      uint64_t a_last = load_key(a + (i + block - 1) * width, width);      \
+      uint64_t b_last = load_key(b + (j + block - 1) * width, width);      \
+      if ((a_last ^ flip) <= (b_last ^ flip)) {                            \
+        n += emit_masked(out + n * width, a + i * width,                   \
+                         keep ? matched : ~matched & all, width);          \
+        i += block;                                                        \
+        matched = 0;                                                       \
+      } else {                                                             \
+        j += block;                                                        \
+      }                                                                    \
+    }                                                                      \
+    return n + match_tail(a + i * width, na - i, b + j * width, nb - j,    \
+                          flip, keep, matched, out + n * width, width);    \
+  }
+
+define_matcher(sse2, "sse2", 4) define_matcher(sse2, "sse2", 8)
+define_matcher(avx2, "avx2", 4) define_matcher(avx2, "avx2", 8)
+
+#endif  // has_block_kernels
+
+// Returns a block kernel for intersecting or differencing a and b by key, or
+// NULL if the items aren't bare integer keys, the inputs differ too much in
+// size, or there's no kernel for this CPU.
+static MatchFunction block_matcher(Array a, Array b, size_t key_offset,
+                                   array__KeyType type) {
+#ifdef has_block_kernels
+  size_t width = (type == array__key_i32 || type == array__key_u32) ? 4 : 8;
+  if (type == array__key_f32 || type == array__key_f64 || key_offset != 0 ||
+      a->item_size != width || b->item_size != width) return NULL;
+  size_t na = a->count, nb = b->count;
+  if (na / GALLOP_RATIO > nb || nb / GALLOP_RATIO > na) return NULL;
+  if (__builtin_cpu_supports("avx2")) {
+    return width == 4 ? match_avx2_4 : match_avx2_8;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return width == 4 ? match_sse2_4 : match_sse2_8;
+  }
+#endif
+  return NULL;
+}
+
+static int set_op_by_key(Array out, Array a, Array b, size_t key_offset,
+                         array__KeyType type, SetOp op) {
+  KeyInfo info  = { key_offset, type };
+  Order   order = { compare_keys, &info, a->item_size };
+  MatchFunction match = NULL;
+  if (op != op_union) match = block_matcher(a, b, key_offset, type);
+  if (match == NULL) return merge_two(out, a, b, &order, op);
+
+  size_t na = a->count, nb = b->count;
+  char *dst = reserve(out, na);
+  if (dst == NULL) return 0;
+  // Flipping the sign bit puts signed keys in unsigned order.
+  uint64_t flip = (type == array__key_i32) ? 0x80000000u :
+                  (type == array__key_i64) ? 0x8000000000000000ull : 0;
+  out->count += match(a->items, na, b->items, nb, flip,
+                      op == op_intersect, dst);
+  return 1;
+}
+
+
+// Public functions.
+// =================
+
+int array__sorted_intersect(Array out, Array a, Array b,
+                            array__CompareFunction compare,
+                            void *compare_context) {
+  Order order = { compare, compare_context, a->item_size };
+  return merge_two(out, a, b, &order, op_intersect);
+}
+
+int array__sorted_union(Array out, Array a, Array b,
+                        array__CompareFunction compare,
+                        void *compare_context) {
+  Order order = { compare, compare_context, a->item_size };
+  return merge_two(out, a, b, &order, op_union);
+}
+
+int array__sorted_difference(Array out, Array a, Array b,
+                             array__CompareFunction compare,
+                             void *compare_context) {
+  Order order = { compare, compare_context, a->item_size };
+  return merge_two(out, a, b, &order, op_difference);
+}
+
+int array__merge_sorted(Array out, Array *arrays, int num_arrays,
+                        array__CompareFunction compare,
+                        void *compare_context) {
+  Order order = { compare, compare_context, out->item_size };
+  return merge_many(out, arrays, num_arrays, &order);
+}
+
+int array__sorted_intersect_by_key(Array out, Array a, Array b,
+                                   size_t key_offset, array__KeyType type) {
+  return set_op_by_key(out, a, b, key_offset, type, op_intersect);
+}
+
+int array__sorted_union_by_key(Array out, Array a, Array b,
+                               size_t key_offset, array__KeyType type) {
+  return set_op_by_key(out, a, b, key_offset, type, op_union);
+}
+
+int array__sorted_difference_by_key(Array out, Array a, Array b,
+                                    size_t key_offset, array__KeyType type) {
+  return set_op_by_key(out, a, b, key_offset, type, op_difference);
+}
+
+int array__merge_sorted_by_key(Array out, Array *arrays, int num_arrays,
+                               size_t key_offset, array__KeyType type) {
+  KeyInfo info  = { key_offset, type };
+  Order   order = { compare_keys, &info, out->item_size };
+  return merge_many(out, arrays, num_arrays, &order);
+}
@@ -0,0 +1,63 @@
+// sortedset.h
+//
+// https://github.com/tylerneylon/cstructs
+//
+// Set operations over sorted Arrays, such as posting lists.
+//
+// The inputs must already be sorted: by compare, with a NULL compare meaning
+// memcmp order, just as for array__sort and array__lower_bound; or, for the
+// *_by_key functions, by a numeric key, just as array__sort_by_key leaves
+// them. All of the arrays, including out, must have the same item size.
+//
+// Results are appended to out, which must not be one of the inputs, and are
+// sorted too. Each function reserves room for its largest possible result
+// first, and returns 0, leaving out unchanged, if it can't; otherwise it
+// returns 1.
+//
+// Duplicates are kept as follows, which for inputs without duplicates is
+// ordinary set algebra:
+//
+//  * array__sorted_intersect keeps each item of a that equals an item of b.
+//  * array__sorted_difference keeps each item of a that equals no item of b.
+//  * array__sorted_union keeps every item of a, plus each item of b that
+//    equals no item of a.
+//  * array__merge_sorted keeps every item of every array; equal items are in
+//    the order of the arrays they came from.
+//
+// The merges take linear time, but skip ahead with galloping (exponential)
+// searches, so a small input against a large one takes O(m log(n / m))
+// compares rather than O(n + m), and long runs are copied with one memcpy.
+// The *_by_key versions of intersect and difference compare blocks of keys
+// at a time with SSE2 or AVX2 instructions when the items are just 4- or
+// 8-byte integer keys and the inputs are of similar sizes.
+//
+
+#pragma once
+
+#include "array.h"
+
+#include <stdlib.h>
+
+int array__sorted_intersect  (Array out, Array a, Array b,
+                              array__CompareFunction compare,
+                              void *compare_context);
+int array__sorted_union      (Array out, Array a, Array b,
+                              array__CompareFunction compare,
+                              void *compare_context);
+int array__sorted_difference (Array out, Array a, Array b,
+                              array__CompareFunction compare,
+                              void *compare_context);
+int array__merge_sorted      (Array out, Array *arrays, int num_arrays,
+                              array__CompareFunction compare,
+                              void *compare_context);
+
+// These compare items by the numeric key found key_offset bytes into each
+// item.
+int array__sorted_intersect_by_key  (Array out, Array a, Array b,
+                                     size_t key_offset, array__KeyType type);
+int array__sorted_union_by_key      (Array out, Array a, Array b,
+                                     size_t key_offset, array__KeyType type);
+int array__sorted_difference_by_key (Array out, Array a, Array b,
+                                     size_t key_offset, array__KeyType type);
+int array__merge_sorted_by_key      (Array out, Array *arrays, int num_arrays,
+                                     size_t key_offset, array__KeyType type);
@@ -40,7 +40,7 @@ int main() {
   // The first parameter = the type of the iterator =
   // a pointer to the type sent into array__new.
   array__for(char **, str_ptr, array, index) {
-    printf("array[%d]=%s\n", index, *str_ptr);
+    printf("array[%zu]=%s\n", index, *str_ptr);
   }
   // Prints out: hi what's up
 
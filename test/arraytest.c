@@ -7,12 +7,17 @@
 
 #include "ctest.h"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 #include "winutil.h"
 
 #define array_size(x) (sizeof(x) / sizeof(x[0]))
@@ -156,6 +161,427 @@ int test_sort() {
   return test_success;
 }
 
+// Sorting with a NULL compare function gives memcmp order.
+static size_t qsort_item_size;
+static int qsort_memcmp(const void *item1, const void *item2) {
+  return memcmp(item1, item2, qsort_item_size);
+}
+
+int test_radix_sort() {
+  size_t item_sizes[] = {1, 3, 8, 20};
+  int counts[] = {0, 1, 10, 5000};
+  for (int s = 0; s < array_size(item_sizes); ++s) {
+    for (int c = 0; c < array_size(counts); ++c) {
+      size_t size = item_sizes[s];
+      Array array = array__new(0, size);
+      for (int i = 0; i < counts[c]; ++i) {
+        unsigned char *item = array__new_ptr(array);
+        // Use a small alphabet and shared prefixes so that many items tie.
+        for (size_t j = 0; j < size; ++j) {
+          item[j] = (j < size / 2) ? 7 : rand() % 5;
+        }
+        if (size > 1) item[0] = rand() % 3 * 100;
+      }
+      char *expected = malloc(counts[c] * size + 1);
+      memcpy(expected, array->items, counts[c] * size);
+      qsort_item_size = size;
+      qsort(expected, counts[c], size, qsort_memcmp);
+
+      array__sort(array, NULL, NULL);
+      test_printf("item_size=%zu count=%d\n", size, counts[c]);
+      test_that(memcmp(array->items, expected, counts[c] * size) == 0);
+
+      free(expected);
+      array__delete(array);
+    }
+  }
+  return test_success;
+}
+
+typedef struct {
+  int key;
+  int order;
+} SortRecord;
+
+int compare_sort_records(void *context, const void *r1, const void *r2) {
+  int k1 = ((SortRecord *)r1)->key;
+  int k2 = ((SortRecord *)r2)->key;
+  return (k1 > k2) - (k1 < k2);
+}
+
+#ifndef _WIN32
+
+// The context is the direction of the sort: 1 for ascending, -1 for
+// descending. It's read on every comparison, so sorts that shared their
+// context would mix up their orders.
+int compare_ints_in_direction(void *context, const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return *(int *)context * ((x > y) - (x < y));
+}
+
+typedef struct {
+  Array array;
+  int   direction;
+} SortJob;
+
+void *run_sort_job(void *job_ptr) {
+  SortJob *job = job_ptr;
+  array__sort(job->array, compare_ints_in_direction, &job->direction);
+  return NULL;
+}
+
+#endif
+
+// Check that two sorts with different contexts can run at once.
+int test_concurrent_sorts() {
+#ifndef _WIN32
+  SortJob jobs[2] = {{NULL, 1}, {NULL, -1}};
+  for (int j = 0; j < 2; ++j) {
+    jobs[j].array = array__new(0, sizeof(int));
+    for (int i = 0; i < 300000; ++i) {
+      int item = rand();
+      array__add_item_val(jobs[j].array, item);
+    }
+  }
+  pthread_t threads[2];
+  for (int j = 0; j < 2; ++j) {
+    pthread_create(&threads[j], NULL, run_sort_job, &jobs[j]);
+  }
+  for (int j = 0; j < 2; ++j) pthread_join(threads[j], NULL);
+
+  for (int j = 0; j < 2; ++j) {
+    Array array = jobs[j].array;
+    int is_sorted = 1;
+    for (int i = 1; i < array->count; ++i) {
+      int prev = array__item_val(array, i - 1, int);
+      int item = array__item_val(array, i, int);
+      is_sorted &= (jobs[j].direction == 1 ? prev <= item : prev >= item);
+    }
+    test_that(is_sorted);
+    array__delete(array);
+  }
+#endif
+  return test_success;
+}
+
+// Check that parallel sorting works for a range of thread counts and sizes.
+int test_parallel_sort() {
+  int num_threads[] = {1, 2, 3, 4, 7};
+  int counts[] = {0, 5, 1000, 100003};
+  for (int t = 0; t < array_size(num_threads); ++t) {
+    for (int c = 0; c < array_size(counts); ++c) {
+      Array array = array__new(0, sizeof(SortRecord));
+      for (int i = 0; i < counts[c]; ++i) {
+        SortRecord *r = array__new_ptr(array);
+        r->key = rand() % 1000;
+        r->order = i;
+      }
+      array__parallel_sort(array, compare_sort_records, NULL, num_threads[t]);
+      test_printf("threads=%d count=%d\n", num_threads[t], counts[c]);
+      test_that(array->count == counts[c]);
+      for (int i = 1; i < array->count; ++i) {
+        SortRecord *prev = array__item_ptr(array, i - 1);
+        SortRecord *r    = array__item_ptr(array, i);
+        test_that(prev->key <= r->key);
+      }
+      array__delete(array);
+    }
+  }
+
+  // A NULL compare function still means memcmp order.
+  Array array = array__new(0, 3);
+  for (int i = 0; i < 50000; ++i) {
+    char *item = array__new_ptr(array);
+    for (int j = 0; j < 3; ++j) item[j] = rand() % 7;
+  }
+  array__parallel_sort(array, NULL, NULL, 4);  // 4 --> num_threads
+  for (int i = 1; i < array->count; ++i) {
+    test_that(memcmp(array__item_ptr(array, i - 1),
+                     array__item_ptr(array, i), 3) <= 0);
+  }
+  array__delete(array);
+
+  return test_success;
+}
+
+// Sorting with many duplicates and with already-sorted input shouldn't go
+// quadratic or lose items.
+int test_sort_patterns() {
+  int n = 20000;
+  Array array = array__new(n, sizeof(SortRecord));
+  for (int pattern = 0; pattern < 4; ++pattern) {
+    array__clear(array);
+    for (int i = 0; i < n; ++i) {
+      SortRecord *r = array__new_ptr(array);
+      int keys[] = {i, n - i, 7, i % 3};
+      r->key = keys[pattern];
+      r->order = i;
+    }
+    array__sort(array, compare_sort_records, NULL);
+    long order_sum = 0;
+    for (int i = 0; i < n; ++i) {
+      SortRecord *r = array__item_ptr(array, i);
+      SortRecord *prev = (i ? array__item_ptr(array, i - 1) : r);
+      test_that(prev->key <= r->key);
+      order_sum += r->order;
+    }
+    test_that(order_sum == (long)n * (n - 1) / 2);
+  }
+  array__delete(array);
+  return test_success;
+}
+
+array__define_sort(sort_ints, int, *a < *b)
+array__define_sort(sort_records_desc, SortRecord, a->key > b->key)
+
+// The typed sort should match a radix sort on inputs that exercise each of its
+// special cases: sorted runs, reversed runs, many duplicates, and noise.
+int test_define_sort() {
+  int n = 50000;
+  Array ints = array__new(n, sizeof(int));
+  Array expected = array__new(n, sizeof(int));
+  Array records = array__new(n, sizeof(SortRecord));
+  srand(42);
+  for (int pattern = 0; pattern < 6; ++pattern) {
+    array__clear(ints);
+    array__clear(expected);
+    array__clear(records);
+    for (int i = 0; i < n; ++i) {
+      int vals[] = {rand(), i, n - i, rand() % 4, i % 1000, i ^ 1};
+      array__add_item_val(ints, vals[pattern]);
+      array__add_item_val(expected, vals[pattern]);
+      SortRecord *r = array__new_ptr(records);
+      r->key = vals[pattern];
+      r->order = i;
+    }
+
+    sort_ints(ints);
+    array__sort_by_key(expected, 0, array__key_i32);
+    test_that(memcmp(ints->items, expected->items, n * sizeof(int)) == 0);
+
+    sort_records_desc(records);
+    long order_sum = 0;
+    for (int i = 0; i < n; ++i) {
+      SortRecord *r = array__item_ptr(records, i);
+      SortRecord *prev = (i ? array__item_ptr(records, i - 1) : r);
+      test_that(prev->key >= r->key);
+      order_sum += r->order;
+    }
+    test_that(order_sum == (long)n * (n - 1) / 2);
+  }
+
+  // The _items variant works on plain C arrays, including tiny ones.
+  int small[] = {3, 1, 2};
+  sort_ints_items(small, 0);
+  sort_ints_items(small, 1);
+  test_that(small[0] == 3);
+  sort_ints_items(small, array_size(small));
+  test_that(small[0] == 1 && small[1] == 2 && small[2] == 3);
+
+  array__delete(records);
+  array__delete(expected);
+  array__delete(ints);
+  return test_success;
+}
+
+int compare_sort_records_desc(void *context, const void *r1, const void *r2) {
+  return compare_sort_records(context, r2, r1);
+}
+
+// Selection should agree with a full sort on patterns with many duplicates,
+// sorted and reversed runs, and noise.
+int test_selection() {
+  int n = 10000;
+  Array array = array__new(n, sizeof(SortRecord));
+  Array sorted = array__new(n, sizeof(SortRecord));
+  Array out = array__new(0, sizeof(SortRecord));
+  srand(7);
+  for (int pattern = 0; pattern < 4; ++pattern) {
+    array__clear(sorted);
+    for (int i = 0; i < n; ++i) {
+      int keys[] = {rand(), i, n - i, rand() % 5};
+      SortRecord r = { keys[pattern], i };
+      array__add_item_val(sorted, r);
+    }
+    array__clear(array);
+    array__append_array(array, sorted);
+    array__sort(sorted, compare_sort_records, NULL);
+
+    size_t nths[] = {0, 1, 17, n / 2, n - 1};
+    for (int t = 0; t < array_size(nths); ++t) {
+      size_t nth = nths[t];
+      array__nth_element(array, nth, compare_sort_records, NULL);
+      int key = array__item_val(array, nth, SortRecord).key;
+      test_that(key == array__item_val(sorted, nth, SortRecord).key);
+      int is_split = 1;
+      array__for(SortRecord *, r, array, i) {
+        is_split &= (i < nth) ? (r->key <= key) : (r->key >= key);
+      }
+      test_that(is_split);
+    }
+
+    size_t ks[] = {0, 1, 100, n, n + 5};
+    for (int t = 0; t < array_size(ks); ++t) {
+      size_t k = ks[t] < n ? ks[t] : n;
+      array__partial_sort(array, ks[t], compare_sort_records, NULL);
+      int is_sorted_prefix = 1;
+      for (size_t i = 0; i < k; ++i) {
+        is_sorted_prefix &= (array__item_val(array, i, SortRecord).key ==
+                             array__item_val(sorted, i, SortRecord).key);
+      }
+      test_that(is_sorted_prefix);
+
+      // The greatest k items, with a reversed compare function.
+      array__clear(out);
+      test_that(array__top_k(out, array, ks[t], compare_sort_records_desc,
+                             NULL));
+      test_that(out->count == k);
+      int is_top = 1;
+      for (size_t i = 0; i < k; ++i) {
+        is_top &= (array__item_val(out, i, SortRecord).key ==
+                   array__item_val(sorted, n - 1 - i, SortRecord).key);
+      }
+      test_that(is_top);
+    }
+    test_that(array->count == n);
+  }
+
+  // A NULL compare function means memcmp order.
+  int bytes[] = {0x0300, 0x0101, 0x0200, 0x0001};
+  Array ints = array__new(4, sizeof(int));
+  for (int i = 0; i < 4; ++i) array__add_item_val(ints, bytes[i]);
+  array__nth_element(ints, 0, NULL, NULL);
+  test_that(array__item_val(ints, 0, int) == 0x0200);
+  Array least = array__new(2, sizeof(int));
+  test_that(array__top_k(least, ints, 2, NULL, NULL));
+  test_that(array__item_val(least, 1, int) == 0x0300);
+
+  array__delete(least);
+  array__delete(ints);
+  array__delete(out);
+  array__delete(sorted);
+  array__delete(array);
+  return test_success;
+}
+
+int test_stable_sort() {
+  int counts[] = {0, 1, 16, 17, 1000, 50003};
+  srand(8);
+  for (int c = 0; c < array_size(counts); ++c) {
+    for (int pattern = 0; pattern < 3; ++pattern) {
+      Array array = array__new(0, sizeof(SortRecord));
+      for (int i = 0; i < counts[c]; ++i) {
+        int keys[] = {rand() % 50, i / 100, (counts[c] - i) / 7};
+        SortRecord r = { keys[pattern], i };
+        array__add_item_val(array, r);
+      }
+      test_that(array__stable_sort(array, compare_sort_records, NULL));
+      test_that(array->count == counts[c]);
+      int is_stable = 1;
+      for (int i = 1; i < array->count; ++i) {
+        SortRecord *prev = array__item_ptr(array, i - 1);
+        SortRecord *r    = array__item_ptr(array, i);
+        is_stable &= (prev->key < r->key) ||
+                     (prev->key == r->key && prev->order < r->order);
+      }
+      test_that(is_stable);
+      array__delete(array);
+    }
+  }
+  return test_success;
+}
+
+// The vectorized widths, and a couple of others, should agree with a plain
+// memcmp loop for matches at every position relative to vector boundaries.
+int test_find_linear() {
+  size_t widths[] = {1, 2, 3, 4, 8, 16};
+  size_t counts[] = {0, 1, 7, 31, 64, 200, 1001};
+  srand(7);
+  for (int w = 0; w < array_size(widths); ++w) {
+    size_t width = widths[w];
+    for (int c = 0; c < array_size(counts); ++c) {
+      size_t n = counts[c];
+      Array array = array__new(n, width);
+      // Bytes come from a tiny alphabet so that partial matches are common.
+      array__add_zeroed_items(array, n);
+      for (size_t i = 0; i < n * width; ++i) array->items[i] = 1 + rand() % 2;
+      char needle[16];
+      for (int trial = 0; trial < 20; ++trial) {
+        for (size_t b = 0; b < width; ++b) needle[b] = 1 + rand() % 2;
+        size_t first = n, num_equal = 0;
+        for (size_t i = 0; i < n; ++i) {
+          if (memcmp(array__item_ptr(array, i), needle, width)) continue;
+          if (first == n) first = i;
+          num_equal++;
+        }
+        void *found = array__find_linear(array, needle);
+        test_that(found == (first < n ? array__item_ptr(array, first) : NULL));
+        test_that(array__count_equal(array, needle) == num_equal);
+      }
+      // A needle that matches nothing, and then only the last item.
+      memset(needle, 3, width);
+      test_that(array__find_linear(array, needle) == NULL);
+      if (n) {
+        memset(array__item_ptr(array, n - 1), 3, width);
+        test_that(array__find_linear(array, needle) ==
+                  array__item_ptr(array, n - 1));
+        test_that(array__count_equal(array, needle) == 1);
+      }
+      array__delete(array);
+    }
+  }
+  return test_success;
+}
+
+typedef struct {
+  char   tag;
+  double d;
+  int    i;
+  int    order;
+} KeyedRecord;
+
+int test_sort_by_key() {
+  Array array = array__new(0, sizeof(KeyedRecord));
+  double doubles[] = {3.5, -0.0, -7.25, 1e300, 0.0, -1e-300, 3.5, -7.25};
+  int ints[] = {5, -1, 2147483647, -2147483647 - 1, 0, 5, -1, 3};
+  for (int i = 0; i < array_size(doubles); ++i) {
+    KeyedRecord *r = array__new_ptr(array);
+    r->tag = 'a' + i;
+    r->d = doubles[i];
+    r->i = ints[i];
+    r->order = i;
+  }
+
+  array__sort_by_key(array, offsetof(KeyedRecord, d), array__key_f64);
+  KeyedRecord *prev = NULL;
+  array__for(KeyedRecord *, r, array, i) {
+    if (prev) test_that(prev->d <= r->d);
+    prev = r;
+  }
+  // Equal keys keep their original order.
+  test_that(array__item_val(array, 0, KeyedRecord).tag == 'c');
+  test_that(array__item_val(array, 1, KeyedRecord).tag == 'h');
+  test_that(array__item_val(array, 7, KeyedRecord).d == 1e300);
+  // The sign bit orders -0.0 before 0.0.
+  test_that(array__item_val(array, 3, KeyedRecord).tag == 'b');
+  test_that(array__item_val(array, 4, KeyedRecord).tag == 'e');
+
+  array__sort_by_key(array, offsetof(KeyedRecord, i), array__key_i32);
+  prev = NULL;
+  array__for(KeyedRecord *, r, array, i) {
+    if (prev) test_that(prev->i <= r->i);
+    prev = r;
+  }
+  test_that(array__item_val(array, 0, KeyedRecord).i == -2147483647 - 1);
+  test_that(array__item_val(array, 7, KeyedRecord).i == 2147483647);
+  // The items with key 5 were in the order 'f', 'a' after the last sort.
+  test_that(array__item_val(array, 5, KeyedRecord).tag == 'f');
+  test_that(array__item_val(array, 6, KeyedRecord).tag == 'a');
+
+  array__delete(array);
+  return test_success;
+}
+
 int test_remove() {
   Array array = array__new(0, sizeof(double));
   double values[] = {2.0, 3.0, 5.0, 7.0};
@@ -173,6 +599,65 @@ int test_remove() {
   return test_success;
 }
 
+int is_odd(void *item, void *context) {
+  return *(int *)item % 2;
+}
+
+static int num_released_items = 0;
+
+void count_releases(void *item, void *context) {
+  num_released_items++;
+}
+
+int test_bulk_remove() {
+  Array array = array__new(0, sizeof(int));
+  for (int i = 0; i < 1000; ++i) array__add_item_val(array, i);
+
+  test_that(array__remove_if(array, is_odd, NULL) == 500);
+  test_that(array->count == 500);
+  int in_order = 1;
+  array__for(int *, item, array, i) in_order &= (*item == 2 * (int)i);
+  test_that(in_order);
+  test_that(array__remove_if(array, is_odd, NULL) == 0);
+
+  // Remove every item from runs of various lengths, including whole words of
+  // 64 items, and the last few items.
+  array__clear(array);
+  for (int i = 0; i < 1000; ++i) array__add_item_val(array, i);
+  uint64_t remove_bits[16] = {0};
+  int expect_removed[1000] = {0};
+  size_t num_to_remove = 0;
+  for (int i = 0; i < 1000; ++i) {
+    int should_remove = (i / 7) % 3 == 0 || (i >= 128 && i < 320) || i > 995;
+    if (!should_remove) continue;
+    remove_bits[i / 64] |= 1ull << (i % 64);
+    expect_removed[i] = 1;
+    num_to_remove++;
+  }
+  array->releaser = count_releases;
+  test_that(array__remove_masked(array, remove_bits) == num_to_remove);
+  test_that(num_released_items == num_to_remove);
+  test_that(array->count == 1000 - num_to_remove);
+  size_t index = 0;
+  for (int i = 0; i < 1000; ++i) {
+    if (expect_removed[i]) continue;
+    test_that(array__item_val(array, index++, int) == i);
+  }
+
+  // Swap-removal moves the last item into the hole.
+  array->releaser = NULL;
+  int last = array__item_val(array, array->count - 1, int);
+  size_t count = array->count;
+  array__swap_remove(array, array__item_ptr(array, 3));
+  test_that(array->count == count - 1);
+  test_that(array__item_val(array, 3, int) == last);
+  array__swap_remove(array, array__item_ptr(array, array->count - 1));
+  test_that(array->count == count - 2);
+
+  array__delete(array);
+  return test_success;
+}
+
 int test_indexof() {
   Array array = array__new(0, sizeof(double));
   double values[] = {2.0, 3.0, 5.0, 7.0};
@@ -215,6 +700,39 @@ int test_find() {
   return test_success;
 }
 
+int test_bounds() {
+  Array array = array__new(0, sizeof(double));
+  double values[] = {1.0, 2.0, 2.0, 2.0, 5.0};
+  for (int i = 0; i < array_size(values); ++i) {
+    array__add_item_val(array, values[i]);
+  }
+
+  double needles[]  = {0.0, 1.0, 2.0, 3.0, 5.0, 6.0};
+  size_t lower[]    = {0,   0,   1,   4,   4,   5};
+  size_t upper[]    = {0,   1,   4,   4,   5,   5};
+  for (int i = 0; i < array_size(needles); ++i) {
+    test_that(array__lower_bound(array, &needles[i],
+                                 compare_doubles, NULL) == lower[i]);
+    test_that(array__upper_bound(array, &needles[i],
+                                 compare_doubles, NULL) == upper[i]);
+    test_that(array__lower_bound_by_key(array, 0, array__key_f64,
+                                        &needles[i]) == lower[i]);
+  }
+  array__delete(array);
+
+  // A NULL compare function means memcmp order.
+  array = array__new(0, sizeof(char));
+  for (char c = 'a'; c <= 'z'; c += 2) array__add_item_val(array, c);
+  char needle = 'e';
+  test_that(array__lower_bound(array, &needle, NULL, NULL) == 2);
+  test_that(array__upper_bound(array, &needle, NULL, NULL) == 3);
+  needle = 'f';
+  test_that(array__lower_bound(array, &needle, NULL, NULL) == 3);
+  array__delete(array);
+
+  return test_success;
+}
+
 int test_string_array() {
   Array array = array__new(4, sizeof(char *));
 
@@ -415,16 +933,351 @@ int test_insert_items() {
 }
 
 
+// Growth that would overflow a size_t should fail cleanly, without changing
+// the array.
+int test_overflow_checks() {
+  test_that(array__new(SIZE_MAX / 2, sizeof(int)) == NULL);
+
+  Array array = array__new(4, sizeof(int));
+  int value = 7;
+  array__add_item_val(array, value);
+  char *items = array->items;
+  test_that(array__add_zeroed_items(array, SIZE_MAX) == NULL);
+  test_that(array__add_zeroed_items(array, SIZE_MAX / sizeof(int)) == NULL);
+  test_that(array__insert_items(array, 0, &value, SIZE_MAX / 2) == NULL);
+  test_that(array->count == 1);
+  test_that(array->capacity == 4);
+  test_that(array->items == items);
+  test_that(array__item_val(array, 0, int) == 7);
+
+  // A plain-sized request still works afterwards.
+  int *new_items = array__add_zeroed_items(array, 10);
+  test_that(new_items == array__item_ptr(array, 1));
+  test_that(array->count == 11);
+  array__delete(array);
+
+  return test_success;
+}
+
+// Arrays that outgrow array__mmap_threshold move into a memory mapping on
+// Linux, and should keep their items through the move and later growth.
+int test_mmap_storage() {
+  size_t n = 3 * (array__mmap_threshold / sizeof(int));
+  Array array = array__new(0, sizeof(int));
+  array__use_huge_pages(array, 1);
+  test_that(array->storage == array__storage_heap);
+  for (size_t i = 0; i < n; ++i) array__new_val(array, int) = (int)i;
+#ifdef array__has_mmap
+  test_that(array->storage == array__storage_mmap);
+#endif
+  int all_match = 1;
+  array__for(int *, item, array, i) all_match &= (*item == (int)i);
+  test_that(all_match);
+
+  test_that(array__add_zeroed_items(array, n) != NULL);
+  test_that(array__item_val(array, n - 1, int) == (int)(n - 1));
+  test_that(array__item_val(array, 2 * n - 1, int) == 0);
+  array__use_huge_pages(array, 0);
+
+  // A released array can be reused, and starts again on the heap.
+  array__release(array);
+  array__init(array, 1, sizeof(int));
+  test_that(array->storage == array__storage_heap);
+  array__delete(array);
+
+  // Arrays that start out big go straight to a mapping.
+  array = array__new(array__mmap_threshold, 1);
+#ifdef array__has_mmap
+  test_that(array->storage == array__storage_mmap);
+#endif
+  array__delete(array);
+
+  return test_success;
+}
+
+static int num_freed_strings = 0;
+
+void free_string(void *str_ptr, void *context) {
+  free(*(char **)str_ptr);
+  num_freed_strings++;
+}
+
+// Inline arrays should behave like any other Array before and after they
+// spill to the heap.
+int test_inline_storage() {
+  array__inline_struct(int, 4) ints_struct;
+  Array ints = array__init_inline_struct(&ints_struct);
+  test_that(ints->capacity == 4);
+  test_that(ints->storage == array__storage_inline);
+  for (int i = 0; i < 4; ++i) array__add_item_val(ints, i);
+  test_that(ints->items == (char *)ints_struct.inline_items);
+  test_that(ints->storage == array__storage_inline);
+
+  for (int i = 4; i < 100; ++i) array__add_item_val(ints, i);
+  test_that(ints->storage == array__storage_heap);
+  test_that(ints->items != (char *)ints_struct.inline_items);
+  int in_order = 1;
+  array__for(int *, item, ints, i) in_order &= (*item == (int)i);
+  test_that(in_order);
+  array__release(ints);
+
+  // One block holds both the struct and its items, and the releaser works
+  // either way.
+  for (int num_items = 2; num_items <= 6; num_items += 4) {
+    Array strs = array__new_inline(4, sizeof(char *));
+    strs->releaser = free_string;
+    test_that(strs->items ==
+              (char *)strs + array__align_up(sizeof(ArrayStruct)));
+    for (int i = 0; i < num_items; ++i) {
+      char *str = strdup("tag");
+      array__add_item_val(strs, str);
+    }
+    test_that(strs->storage == (num_items <= 4 ? array__storage_inline
+                                               : array__storage_heap));
+    array__for(char **, str, strs, i) test_that(strcmp(*str, "tag") == 0);
+    num_freed_strings = 0;
+    array__delete(strs);
+    test_that(num_freed_strings == num_items);
+  }
+
+  // Inline items are as aligned as heap items, so any type may be stored.
+  Array wide = array__new_inline(4, sizeof(long double));
+  test_that((uintptr_t)wide->items % array__max_align == 0);
+  long double x = 1.5L;
+  array__add_item_val(wide, x);
+  test_that(array__item_val(wide, 0, long double) == 1.5L);
+  array__delete(wide);
+
+  return test_success;
+}
+
+// Overwrites bytes of the file at path, starting at offset.
+void overwrite_file_bytes(const char *path, long offset, void *bytes,
+                          size_t num_bytes) {
+  FILE *f = fopen(path, "r+b");
+  fseek(f, offset, SEEK_SET);
+  fwrite(bytes, 1, num_bytes, f);
+  fclose(f);
+}
+
+int test_growth_policy() {
+  Array array = array__new(4, sizeof(int));
+  test_that(array->growth_factor == 2.0);
+  array->growth_factor = 1.5;
+  for (int i = 0; i < 5; ++i) array__add_item_val(array, i);
+  test_that(array->capacity == 6);
+  for (int i = 5; i < 7; ++i) array__add_item_val(array, i);
+  test_that(array->capacity == 9);
+
+  // Reserving grows to exactly the capacity asked for, and never shrinks.
+  test_that(array__reserve(array, 100));
+  test_that(array->capacity == 100);
+  test_that(array__reserve(array, 10));
+  test_that(array->capacity == 100);
+  test_that(!array__reserve(array, SIZE_MAX / 2));
+  test_that(array->capacity == 100);
+
+  test_that(array__shrink_to_fit(array));
+  test_that(array->capacity == 7);
+  int all_match = 1;
+  for (int i = 0; i < 7; ++i) {
+    all_match &= (array__item_val(array, i, int) == i);
+  }
+  test_that(all_match);
+  array__delete(array);
+
+  // A factor of 1 or less grows to exactly the size needed, in one step.
+  array = array__new(4, sizeof(int));
+  array->growth_factor = 1.0;
+  array__add_item_val(array, all_match);
+  test_that(array__add_zeroed_items(array, 4) != NULL);
+  test_that(array->capacity == 5);
+  array->growth_factor = 0.5;
+  test_that(array__add_zeroed_items(array, 10000000) != NULL);
+  test_that(array->capacity == 10000005);
+  array__delete(array);
+
+  // An array that shrinks under array__mmap_threshold moves back to the heap.
+  array = array__new(0, 1);
+  test_that(array__add_zeroed_items(array, array__mmap_threshold) != NULL);
+  array->count = 10;
+  test_that(array__shrink_to_fit(array));
+  test_that(array->capacity == 10);
+  test_that(array->storage == array__storage_heap);
+  array__delete(array);
+
+  // Inline storage is left alone.
+  array__inline_struct(int, 8) inline_struct;
+  array = array__init_inline_struct(&inline_struct);
+  test_that(array__shrink_to_fit(array));
+  test_that(array->capacity == 8);
+  test_that(array->items == (char *)inline_struct.inline_items);
+
+  return test_success;
+}
+
+int test_append_items() {
+  Array array = array__new(1, sizeof(int));
+  int ints[] = {1, 2, 3, 4, 5};
+  int *first = array__append_items(array, ints, 5);
+  test_that(first == array__item_ptr(array, 0));
+  test_that(array->count == 5);
+  test_that(array__append_items(array, NULL, 0) == array__item_ptr(array, 5));
+
+  // Items from the array itself are read from where they are before growth.
+  array__append_items(array, array__item_ptr(array, 1), 3);
+  array__append_array(array, array);
+  int expected[] = {1, 2, 3, 4, 5, 2, 3, 4, 1, 2, 3, 4, 5, 2, 3, 4};
+  test_that(array->count == 16);
+  test_that(memcmp(array->items, expected, sizeof(expected)) == 0);
+
+  Array other = array__new(0, sizeof(int));
+  test_that(array__append_array(other, array) != NULL);
+  test_that(other->count == 16);
+  test_that(other->capacity == 16);
+  test_that(memcmp(other->items, expected, sizeof(expected)) == 0);
+
+  array__delete(other);
+  array__delete(array);
+  return test_success;
+}
+
+int test_save_and_open_mapped() {
+  const char *path = "arraytest_save.tmp";
+  Array array = array__new(0, sizeof(SortRecord));
+  for (int i = 0; i < 100000; ++i) {
+    SortRecord r = {i * 3, i};
+    array__add_item_val(array, r);
+  }
+  test_that(array__save(array, path));
+
+  Array mapped = array__open_mapped(path, sizeof(SortRecord));
+  test_that(mapped != NULL);
+  test_that(mapped->storage == array__storage_file);
+  test_that(mapped->count == array->count);
+  test_that(memcmp(mapped->items, array->items,
+                   array->count * array->item_size) == 0);
+  int key = 3 * 777;
+  test_that(array__lower_bound_by_key(mapped, 0, array__key_i32, &key) == 777);
+
+  // Growing the mapped array moves it to the heap, keeping its items.
+  SortRecord r = {-1, -1};
+  array__add_item_val(mapped, r);
+  test_that(mapped->storage != array__storage_file);
+  test_that(mapped->count == array->count + 1);
+  test_that(memcmp(mapped->items, array->items,
+                   array->count * array->item_size) == 0);
+  array__delete(mapped);
+
+  // A mapped array can be changed in place without growing, and the file
+  // keeps its original items.
+  mapped = array__open_mapped(path, sizeof(SortRecord));
+  array__sort(mapped, compare_sort_records_desc, NULL);
+  test_that(array__item_val(mapped, 0, SortRecord).order == 99999);
+  array__remove_item(mapped, array__item_ptr(mapped, 0));
+  array__swap_remove(mapped, array__item_ptr(mapped, 0));
+  test_that(mapped->count == array->count - 2);
+  array__clear(mapped);
+  array__add_item_val(mapped, r);
+  test_that(mapped->storage == array__storage_file);
+  test_that(mapped->count == 1);
+  test_that(array__item_val(mapped, 0, SortRecord).key == -1);
+  array__delete(mapped);
+  mapped = array__open_mapped(path, sizeof(SortRecord));
+  test_that(mapped->count == array->count);
+  test_that(memcmp(mapped->items, array->items,
+                   array->count * array->item_size) == 0);
+  array__delete(mapped);
+
+  // Mismatched item sizes and damaged files are rejected.
+  test_that(array__open_mapped(path, sizeof(int)) == NULL);
+  test_that(array__open_mapped("no_such_file.tmp", sizeof(SortRecord)) == NULL);
+  uint32_t swapped_byte_order = 0x04030201;
+  overwrite_file_bytes(path, 12, &swapped_byte_order, 4);
+  test_that(array__open_mapped(path, sizeof(SortRecord)) == NULL);
+  overwrite_file_bytes(path, 0, "not an array file", 8);
+  test_that(array__open_mapped(path, sizeof(SortRecord)) == NULL);
+
+  // A file cut short is rejected too.
+  array__clear(array);
+  test_that(array__save(array, path));
+  uint64_t big_count = 1000;
+  overwrite_file_bytes(path, 24, &big_count, 8);
+  test_that(array__open_mapped(path, sizeof(SortRecord)) == NULL);
+
+  // An empty array round-trips.
+  test_that(array__save(array, path));
+  mapped = array__open_mapped(path, sizeof(SortRecord));
+  test_that(mapped && mapped->count == 0);
+  array__delete(mapped);
+
+  remove(path);
+  array__delete(array);
+  return test_success;
+}
+
+// This builds arrays of more than 2^31 items and needs about 5 GB of memory,
+// so it only runs when the CSTRUCTS_BIG_TESTS environment variable is set.
+int test_arrays_over_two_gb() {
+  if (getenv("CSTRUCTS_BIG_TESTS") == NULL) return test_success;
+
+  size_t n = (1ull << 31) + 1000;
+  Array array = array__new(16, sizeof(char));
+  for (size_t i = 0; i < n; ++i) {
+    array__new_val(array, char) = (char)(i % 251);
+  }
+  test_that(array->count == n);
+  test_that(array->capacity >= n);
+
+  size_t num_checked = 0, last_index = 0;
+  array__for(char *, c, array, i) {
+    if (*c != (char)(i % 251)) break;
+    num_checked++;
+    last_index = i;
+  }
+  test_that(num_checked == n);
+  test_that(last_index == n - 1);
+
+  // Insert and remove past the 2 GB mark.
+  char abc[] = "abc";
+  array__insert_items(array, n - 10, abc, 3);
+  test_that(array->count == n + 3);
+  test_that(array__item_val(array, n - 10, char) == 'a');
+  test_that(array__item_val(array, n - 7, char) == (char)((n - 10) % 251));
+  test_that(array__index_of(array, array__item_ptr(array, n)) == n);
+  array__remove_item(array, array__item_ptr(array, n - 10));
+  test_that(array__item_val(array, n - 10, char) == 'b');
+  test_that(array->count == n + 2);
+  array__delete(array);
+
+  // Items of more than one byte whose total size is over 4 GB.
+  size_t num_ints = (1ull << 29) + 5;
+  Array ints = array__new(0, sizeof(int64_t));
+  test_that(array__add_zeroed_items(ints, num_ints) != NULL);
+  array__item_val(ints, num_ints - 1, int64_t) = 42;
+  test_that(ints->count * ints->item_size > (1ull << 32));
+  test_that(array__item_val(ints, num_ints - 1, int64_t) == 42);
+  test_that(array__item_val(ints, num_ints - 2, int64_t) == 0);
+  array__delete(ints);
+
+  return test_success;
+}
+
 int main(int argc, char **argv) {
   set_verbose(0);  // Set this to 1 for additional debugging output.
   start_all_tests(argv[0]);
   run_tests(
     test_subarrays, test_int_array, test_releaser,
-    test_clear, test_sort, test_remove, test_find,
+    test_clear, test_sort, test_radix_sort, test_sort_by_key,
+    test_parallel_sort, test_concurrent_sorts, test_sort_patterns,
+    test_define_sort, test_selection, test_stable_sort,
+    test_remove, test_bulk_remove, test_find, test_find_linear, test_bounds,
     test_indexof, test_string_array, test_edge_cases,
     test_empty_loops, test_loops_on_growing_arrays,
     test_two_loops, test_releaser_context,
-    test_insert_items
+    test_insert_items, test_overflow_checks, test_mmap_storage,
+    test_inline_storage, test_growth_policy, test_append_items,
+    test_save_and_open_mapped, test_arrays_over_two_gb
   );
   return end_all_tests();
 }
@@ -0,0 +1,194 @@
+// bitsettest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+// Sets the bits of bitset, and the matching flags, at random.
+void fill_randomly(Bitset bitset, char *flags, int one_in) {
+  for (size_t i = 0; i < bitset->num_bits; ++i) {
+    flags[i] = (rand() % one_in == 0);
+    if (flags[i]) bitset__set(bitset, i);
+  }
+}
+
+int matches_flags(Bitset bitset, char *flags) {
+  size_t count = 0;
+  for (size_t i = 0; i < bitset->num_bits; ++i) {
+    if (bitset__test(bitset, i) != flags[i]) return 0;
+    count += flags[i];
+  }
+  return bitset__count(bitset) == count;
+}
+
+int tail_is_clear(Bitset bitset) {
+  size_t used = bitset->num_bits % 64;
+  if (used == 0 || bitset->words.count == 0) return 1;
+  return (bitset__words(bitset)[bitset->words.count - 1] >> used) == 0;
+}
+
+int test_single_bits() {
+  Bitset bitset = bitset__new(130);
+  test_that(bitset->num_bits == 130);
+  test_that(bitset__count(bitset) == 0);
+
+  size_t indexes[] = {0, 1, 63, 64, 65, 127, 128, 129};
+  for (int i = 0; i < 8; ++i) {
+    test_that(!bitset__test(bitset, indexes[i]));
+    bitset__set(bitset, indexes[i]);
+    test_that(bitset__test(bitset, indexes[i]));
+  }
+  test_that(bitset__count(bitset) == 8);
+  test_that(!bitset__test(bitset, 62));
+
+  bitset__unset(bitset, 64);
+  bitset__unset(bitset, 64);
+  test_that(!bitset__test(bitset, 64));
+  test_that(bitset__test(bitset, 63) && bitset__test(bitset, 65));
+  test_that(bitset__count(bitset) == 7);
+
+  bitset__set_all(bitset);
+  test_that(bitset__count(bitset) == 130);
+  test_that(tail_is_clear(bitset));
+  bitset__clear(bitset);
+  test_that(bitset__count(bitset) == 0);
+
+  bitset__delete(bitset);
+
+  Bitset empty = bitset__new(0);
+  test_that(bitset__count(empty) == 0);
+  test_that(bitset__next_set(empty, 0) == 0);
+  bitset__set_all(empty);
+  test_that(bitset__count(empty) == 0);
+  bitset__delete(empty);
+
+  return test_success;
+}
+
+int test_bulk_ops() {
+  // Sizes that leave the vector loops with 0 to 3 words to finish singly.
+  size_t sizes[] = {1, 64, 200, 256, 1000, 4096, 10000 + 37};
+  srand(3);
+  for (int s = 0; s < 7; ++s) {
+    size_t n = sizes[s];
+    char *a_flags = malloc(n), *b_flags = malloc(n), *expected = malloc(n);
+    for (int op = 0; op < 3; ++op) {
+      Bitset a = bitset__new(n), b = bitset__new(n);
+      fill_randomly(a, a_flags, 3);
+      fill_randomly(b, b_flags, 2);
+      test_that(matches_flags(a, a_flags));
+
+      for (size_t i = 0; i < n; ++i) {
+        expected[i] = (op == 0) ? (a_flags[i] &  b_flags[i]) :
+                      (op == 1) ? (a_flags[i] |  b_flags[i]) :
+                                  (a_flags[i] & !b_flags[i]);
+      }
+      if (op == 0) bitset__and(a, b);
+      if (op == 1) bitset__or(a, b);
+      if (op == 2) bitset__andnot(a, b);
+      test_that(matches_flags(a, expected));
+      test_that(matches_flags(b, b_flags));
+      test_that(tail_is_clear(a));
+
+      bitset__delete(a);
+      bitset__delete(b);
+    }
+    free(a_flags);
+    free(b_flags);
+    free(expected);
+  }
+  return test_success;
+}
+
+int test_next_set() {
+  Bitset bitset = bitset__new(1000);
+  size_t indexes[] = {3, 63, 64, 200, 511, 512, 999};
+  for (int i = 0; i < 7; ++i) bitset__set(bitset, indexes[i]);
+
+  test_that(bitset__next_set(bitset, 0) == 3);
+  test_that(bitset__next_set(bitset, 3) == 3);
+  test_that(bitset__next_set(bitset, 4) == 63);
+  test_that(bitset__next_set(bitset, 65) == 200);
+  test_that(bitset__next_set(bitset, 513) == 999);
+  test_that(bitset__next_set(bitset, 1000) == 1000);
+  test_that(bitset__next_set(bitset, 5000) == 1000);
+
+  int n = 0;
+  bitset__for_set(bitset, index) {
+    test_that(index == indexes[n]);
+    n++;
+  }
+  test_that(n == 7);
+
+  bitset__unset(bitset, 999);
+  test_that(bitset__next_set(bitset, 513) == 1000);
+
+  // The loop body may clear bits as it goes.
+  n = 0;
+  bitset__for_set(bitset, index) {
+    bitset__unset(bitset, index);
+    n++;
+  }
+  test_that(n == 6);
+  test_that(bitset__count(bitset) == 0);
+
+  bitset__delete(bitset);
+  return test_success;
+}
+
+int test_resize() {
+  Bitset bitset = bitset__new(100);
+  bitset__set_all(bitset);
+
+  test_that(bitset__resize(bitset, 70));
+  test_that(bitset->words.count == 2);
+  test_that(bitset__count(bitset) == 70);
+  test_that(tail_is_clear(bitset));
+
+  // Bits that come back after a shrink start as 0.
+  test_that(bitset__resize(bitset, 300));
+  test_that(bitset->num_bits == 300);
+  test_that(bitset__count(bitset) == 70);
+  test_that(bitset__next_set(bitset, 70) == 300);
+
+  test_that(bitset__resize(bitset, 0));
+  test_that(bitset__count(bitset) == 0);
+  test_that(bitset__resize(bitset, 64));
+  test_that(bitset__count(bitset) == 0);
+
+  bitset__delete(bitset);
+  return test_success;
+}
+
+int test_nested_bitsets() {
+  Array bitsets = array__new(4, sizeof(BitsetStruct));
+  bitsets->releaser = bitset__release_with_context;
+  for (size_t i = 0; i < 4; ++i) {
+    Bitset bitset = array__new_ptr(bitsets);
+    test_that(bitset__init(bitset, 50 * (i + 1)) != NULL);
+    bitset__set(bitset, i);
+  }
+  array__for(Bitset, bitset, bitsets, i) {
+    test_that(bitset__count(bitset) == 1);
+    test_that(bitset__next_set(bitset, 0) == i);
+  }
+  array__delete(bitsets);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_single_bits, test_bulk_ops, test_next_set, test_resize,
+            test_nested_bitsets);
+  return end_all_tests();
+}
@@ -0,0 +1,232 @@
+// blobarraytest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+// Adds n random strings of up to max_len lowercase letters, drawn from a
+// small alphabet so that many share long prefixes.
+void add_random_strings(BlobArray blobs, size_t n, int max_len) {
+  char str[64];
+  for (size_t i = 0; i < n; ++i) {
+    int len = rand() % (max_len + 1);
+    for (int j = 0; j < len; ++j) str[j] = 'a' + rand() % 3;
+    str[len] = '\0';
+    blobarray__add_str(blobs, str);
+  }
+}
+
+int compare_strs(void *context, const void *a, const void *b) {
+  return strcmp(*(char **)a, *(char **)b);
+}
+
+int compare_by_length(void *context, const void *a, size_t a_len,
+                      const void *b, size_t b_len) {
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+int test_add_and_get() {
+  BlobArray blobs = blobarray__new();
+  test_that(blobarray__count(blobs) == 0);
+
+  char *hello = blobarray__add_str(blobs, "hello");
+  test_that(strcmp(hello, "hello") == 0);
+  blobarray__add_str(blobs, "");
+  unsigned char bytes[] = {0, 1, 2, 0, 255};
+  blobarray__add(blobs, bytes, sizeof(bytes));
+  blobarray__add(blobs, NULL, 0);
+  test_that(blobarray__count(blobs) == 4);
+
+  size_t len;
+  test_that(strcmp(blobarray__get(blobs, 0, &len), "hello") == 0);
+  test_that(len == 5);
+  test_that(strcmp(blobarray__get(blobs, 1, &len), "") == 0);
+  test_that(len == 0);
+  test_that(memcmp(blobarray__get(blobs, 2, &len), bytes, 5) == 0);
+  test_that(len == 5);
+  blobarray__get(blobs, 3, &len);
+  test_that(len == 0);
+  test_that(blobarray__get(blobs, 0, NULL) == blobs->bytes.items);
+
+  // An item may be added from the blob array's own bytes, even as they move.
+  for (int i = 0; i < 1000; ++i) {
+    char *item = blobarray__get(blobs, blobarray__count(blobs) - 1, &len);
+    if (i == 0) item = blobarray__get(blobs, 0, &len);
+    test_that(blobarray__add(blobs, item, len) != NULL);
+  }
+  test_that(blobarray__count(blobs) == 1004);
+  test_that(strcmp(blobarray__get(blobs, 1003, NULL), "hello") == 0);
+
+  blobarray__clear(blobs);
+  test_that(blobarray__count(blobs) == 0);
+  blobarray__add_str(blobs, "again");
+  test_that(strcmp(blobarray__get(blobs, 0, &len), "again") == 0);
+
+  blobarray__delete(blobs);
+  return test_success;
+}
+
+int test_sort() {
+  srand(4);
+  BlobArray blobs = blobarray__new();
+  add_random_strings(blobs, 5000, 12);
+
+  // The expected order, from sorting pointers to copies of the strings.
+  size_t n = blobarray__count(blobs);
+  Array strs = array__new(n, sizeof(char *));
+  for (size_t i = 0; i < n; ++i) {
+    char *str = strdup(blobarray__get(blobs, i, NULL));
+    array__add_item_val(strs, str);
+  }
+  array__sort(strs, compare_strs, NULL);
+
+  Array order = array__new(0, sizeof(size_t));
+  test_that(blobarray__sort_order(blobs, order, NULL, NULL));
+  test_that(order->count == n);
+  int is_sorted = 1, is_stable = 1;
+  for (size_t i = 0; i < n; ++i) {
+    size_t index = array__item_val(order, i, size_t);
+    is_sorted &= strcmp(blobarray__get(blobs, index, NULL),
+                        array__item_val(strs, i, char *)) == 0;
+    if (i > 0 && strcmp(blobarray__get(blobs, index, NULL),
+                        array__item_val(strs, i - 1, char *)) == 0) {
+      is_stable &= array__item_val(order, i - 1, size_t) < index;
+    }
+  }
+  test_that(is_sorted);
+  test_that(is_stable);
+
+  test_that(blobarray__sort(blobs, NULL, NULL));
+  test_that(blobarray__count(blobs) == n);
+  is_sorted = 1;
+  for (size_t i = 0; i < n; ++i) {
+    is_sorted &= strcmp(blobarray__get(blobs, i, NULL),
+                        array__item_val(strs, i, char *)) == 0;
+  }
+  test_that(is_sorted);
+
+  // Sorting by length keeps byte order among items of the same length.
+  test_that(blobarray__sort(blobs, compare_by_length, NULL));
+  size_t prev_len = 0, len;
+  is_sorted = 1;
+  for (size_t i = 0; i < n; ++i) {
+    char *item = blobarray__get(blobs, i, &len);
+    is_sorted &= (len > prev_len) ||
+                 (len == prev_len &&
+                  (i == 0 || strcmp(blobarray__get(blobs, i - 1, NULL),
+                                    item) <= 0));
+    prev_len = len;
+  }
+  test_that(is_sorted);
+
+  array__for(char **, str, strs, i) free(*str);
+  array__delete(strs);
+  array__delete(order);
+
+  // Items differing only past their first 8 bytes, or in length, or in bytes
+  // above 127, sort in byte order.
+  blobarray__clear(blobs);
+  blobarray__add_str(blobs, "abcdefghz");
+  blobarray__add_str(blobs, "abcdefgh");
+  blobarray__add_str(blobs, "abcdefghy");
+  blobarray__add(blobs, "abc\0", 4);
+  blobarray__add_str(blobs, "abc");
+  blobarray__add_str(blobs, "\xff");
+  test_that(blobarray__sort(blobs, NULL, NULL));
+  test_that(strcmp(blobarray__get(blobs, 0, &len), "abc") == 0 && len == 3);
+  test_that(strcmp(blobarray__get(blobs, 1, &len), "abc") == 0 && len == 4);
+  test_that(strcmp(blobarray__get(blobs, 2, NULL), "abcdefgh") == 0);
+  test_that(strcmp(blobarray__get(blobs, 3, NULL), "abcdefghy") == 0);
+  test_that(strcmp(blobarray__get(blobs, 4, NULL), "abcdefghz") == 0);
+  test_that(strcmp(blobarray__get(blobs, 5, NULL), "\xff") == 0);
+
+  blobarray__clear(blobs);
+  test_that(blobarray__sort(blobs, NULL, NULL));
+  test_that(blobarray__count(blobs) == 0);
+
+  blobarray__delete(blobs);
+  return test_success;
+}
+
+int test_save_and_load() {
+  const char *path = "blobarraytest_save.tmp";
+  srand(5);
+  BlobArray blobs = blobarray__new();
+  add_random_strings(blobs, 2000, 40);
+  test_that(blobarray__save(blobs, path));
+
+  BlobArray loaded = blobarray__load(path);
+  test_that(loaded != NULL);
+  test_that(blobarray__count(loaded) == blobarray__count(blobs));
+  test_that(loaded->bytes.count == blobs->bytes.count);
+  test_that(memcmp(loaded->bytes.items, blobs->bytes.items,
+                   blobs->bytes.count) == 0);
+  size_t len;
+  blobarray__get(loaded, 1999, &len);
+  test_that(strlen(blobarray__get(loaded, 1999, NULL)) == len);
+
+  // The loaded blob array can grow.
+  blobarray__add_str(loaded, "more");
+  test_that(strcmp(blobarray__get(loaded, 2000, NULL), "more") == 0);
+  blobarray__delete(loaded);
+
+  // Damaged files are rejected.
+  test_that(blobarray__load("no_such_file.tmp") == NULL);
+  FILE *f = fopen(path, "r+b");
+  fseek(f, 0, SEEK_END);
+  fputc(0, f);
+  fclose(f);
+  test_that(blobarray__load(path) == NULL);
+
+  test_that(blobarray__save(blobs, path));
+  uint64_t bad_offset = 3;
+  f = fopen(path, "r+b");
+  fseek(f, 64, SEEK_SET);
+  fwrite(&bad_offset, sizeof(bad_offset), 1, f);
+  fclose(f);
+  test_that(blobarray__load(path) == NULL);
+
+  // An empty blob array round-trips.
+  blobarray__clear(blobs);
+  test_that(blobarray__save(blobs, path));
+  loaded = blobarray__load(path);
+  test_that(loaded && blobarray__count(loaded) == 0);
+  blobarray__delete(loaded);
+
+  remove(path);
+  blobarray__delete(blobs);
+  return test_success;
+}
+
+int test_nested_blob_arrays() {
+  Array lists = array__new(3, sizeof(BlobArrayStruct));
+  lists->releaser = blobarray__release_with_context;
+  for (int i = 0; i < 3; ++i) {
+    BlobArray blobs = array__new_ptr(lists);
+    test_that(blobarray__init(blobs) != NULL);
+    for (int j = 0; j <= i; ++j) blobarray__add_str(blobs, "item");
+  }
+  array__for(BlobArray, blobs, lists, i) {
+    test_that(blobarray__count(blobs) == i + 1);
+  }
+  array__delete(lists);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_add_and_get, test_sort, test_save_and_load,
+            test_nested_blob_arrays);
+  return end_all_tests();
+}
@@ -0,0 +1,129 @@
+// colarraytest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "winutil.h"
+
+enum { id_column, price_column, tag_column, num_columns };
+
+static size_t column_sizes[] = {sizeof(int), sizeof(double), 3};
+
+int test_add_rows() {
+  ColArray orders = colarray__new(num_columns, column_sizes);
+  test_that(orders->num_columns == num_columns);
+  test_that(orders->count == 0);
+
+  for (int i = 0; i < 100; ++i) {
+    double price = i * 0.5;
+    char tag[3] = {'a', 'b', (char)i};
+    void *fields[] = {&i, &price, tag};
+    test_that(colarray__add_row(orders, fields));
+  }
+  test_that(orders->count == 100);
+  for (int c = 0; c < num_columns; ++c) {
+    test_that(colarray__column(orders, c)->count == 100);
+    test_that(colarray__column(orders, c)->item_size == column_sizes[c]);
+  }
+
+  // Each column is contiguous.
+  int *ids = colarray__column_ptr(orders, id_column);
+  double *prices = colarray__column_ptr(orders, price_column);
+  for (int i = 0; i < 100; ++i) {
+    test_that(ids[i] == i);
+    test_that(prices[i] == i * 0.5);
+  }
+  char *tag = colarray__item_ptr(orders, tag_column, 42);
+  test_that(tag[0] == 'a' && tag[1] == 'b' && tag[2] == 42);
+  test_that(colarray__item_val(orders, id_column, 99, int) == 99);
+
+  // NULL fields are zeroed.
+  void *fields[] = {NULL, NULL, NULL};
+  test_that(colarray__add_row(orders, fields));
+  test_that(colarray__item_val(orders, id_column, 100, int) == 0);
+  test_that(colarray__item_val(orders, price_column, 100, double) == 0.0);
+
+  test_that(colarray__add_zeroed_rows(orders, 1000));
+  test_that(orders->count == 1101);
+  test_that(colarray__column(orders, tag_column)->count == 1101);
+
+  colarray__clear(orders);
+  test_that(orders->count == 0);
+  test_that(colarray__column(orders, price_column)->count == 0);
+
+  colarray__delete(orders);
+  return test_success;
+}
+
+int test_column_loops() {
+  ColArray orders = colarray__new(num_columns, column_sizes);
+  double expected = 0;
+  for (int i = 0; i < 1000; ++i) {
+    double price = i % 7;
+    void *fields[] = {&i, &price, NULL};
+    colarray__add_row(orders, fields);
+    expected += price;
+  }
+
+  double total = 0;
+  size_t num_rows = 0;
+  colarray__for(double *, price, orders, price_column, row) {
+    total += *price;
+    test_that(row == num_rows);
+    num_rows++;
+  }
+  test_that(total == expected);
+  test_that(num_rows == 1000);
+
+  // A column can be used with array__ functions directly.
+  int id = 500;
+  test_that(array__find_linear(colarray__column(orders, id_column), &id) ==
+            colarray__item_ptr(orders, id_column, 500));
+  double six = 6;
+  test_that(array__count_equal(colarray__column(orders, price_column),
+                               &six) == 142);
+
+  colarray__delete(orders);
+  return test_success;
+}
+
+// Reserving capacity shouldn't change the rows, and growth that fails in one
+// column must leave every column as it was.
+int test_reserve_and_failed_growth() {
+  ColArray orders = colarray__new(num_columns, column_sizes);
+  test_that(colarray__reserve(orders, 5000));
+  test_that(orders->count == 0);
+  for (int c = 0; c < num_columns; ++c) {
+    test_that(colarray__column(orders, c)->count == 0);
+    test_that(colarray__column(orders, c)->capacity >= 5000);
+  }
+  test_that(!colarray__reserve(orders, SIZE_MAX / 4));
+  for (int c = 0; c < num_columns; ++c) {
+    test_that(colarray__column(orders, c)->count == 0);
+  }
+
+  test_that(colarray__add_zeroed_rows(orders, 10));
+  test_that(!colarray__add_zeroed_rows(orders, SIZE_MAX / 4));
+  test_that(orders->count == 10);
+  for (int c = 0; c < num_columns; ++c) {
+    test_that(colarray__column(orders, c)->count == 10);
+  }
+
+  colarray__delete(orders);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_add_rows, test_column_loops, test_reserve_and_failed_growth);
+  return end_all_tests();
+}
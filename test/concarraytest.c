@@ -0,0 +1,119 @@
+// concarraytest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "winutil.h"
+
+typedef struct {
+  int thread;
+  int seq;
+} Record;
+
+int test_single_thread() {
+  ConcArray conc_array = concarray__new(4, sizeof(int));
+  test_that(concarray__count(conc_array) == 0);
+
+  for (int i = 0; i < 10; ++i) {
+    test_that(concarray__append_val(conc_array, i) == (size_t)i);
+  }
+  int batch[1000];
+  for (int i = 0; i < 1000; ++i) batch[i] = 10 + i;
+  // This batch spans several segments.
+  test_that(concarray__append(conc_array, batch, 1000) == 10);
+  test_that(concarray__count(conc_array) == 1010);
+
+  int all_match = 1;
+  for (size_t i = 0; i < 1010; ++i) {
+    all_match &= (concarray__item_val(conc_array, i, int) == (int)i);
+  }
+  test_that(all_match);
+
+  concarray__delete(conc_array);
+  return test_success;
+}
+
+#ifndef _WIN32
+
+#define num_threads   4
+#define num_per_thread 200000
+
+static ConcArray shared;
+
+void *append_records(void *thread_ptr) {
+  Record batch[3];
+  int thread = (int)(intptr_t)thread_ptr;
+  for (int seq = 0; seq < num_per_thread;) {
+    // Mix single appends with small batches.
+    int n = (seq % 5 == 0) ? 3 : 1;
+    if (seq + n > num_per_thread) n = num_per_thread - seq;
+    for (int i = 0; i < n; ++i) batch[i] = (Record){ thread + 1, seq++ };
+    concarray__append(shared, batch, n);
+  }
+  return NULL;
+}
+
+// Returns the number of unwritten items seen; every item below each count
+// seen must already be written.
+void *read_prefix(void *unused) {
+  size_t num_bad = 0, count = 0;
+  while (count < num_threads * num_per_thread) {
+    count = concarray__count(shared);
+    if (count == 0) continue;
+    Record *r = concarray__item_ptr(shared, count - 1);
+    num_bad += (r->thread == 0);
+  }
+  return (void *)num_bad;
+}
+
+int test_many_threads() {
+  shared = concarray__new(1, sizeof(Record));
+  pthread_t threads[num_threads], reader;
+  pthread_create(&reader, NULL, read_prefix, NULL);
+  for (int t = 0; t < num_threads; ++t) {
+    pthread_create(&threads[t], NULL, append_records, (void *)(intptr_t)t);
+  }
+  for (int t = 0; t < num_threads; ++t) pthread_join(threads[t], NULL);
+  void *num_bad;
+  pthread_join(reader, &num_bad);
+  test_that(num_bad == NULL);
+
+  // Every record is present once, and each thread's records are in order.
+  test_that(concarray__count(shared) == num_threads * num_per_thread);
+  int next_seq[num_threads] = {0};
+  int all_in_order = 1;
+  for (size_t i = 0; i < concarray__count(shared); ++i) {
+    Record *r = concarray__item_ptr(shared, i);
+    int t = r->thread - 1;
+    all_in_order &= (t >= 0 && t < num_threads && r->seq == next_seq[t]++);
+  }
+  test_that(all_in_order);
+
+  concarray__delete(shared);
+  return test_success;
+}
+
+#endif
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+#ifdef _WIN32
+  run_tests(test_single_thread);
+#else
+  run_tests(test_single_thread, test_many_threads);
+#endif
+  return end_all_tests();
+}
@@ -0,0 +1,124 @@
+// dequetest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "winutil.h"
+
+int test_push_and_pop() {
+  Deque deque = deque__new(4, sizeof(int));
+  test_that(deque->ring.count == 4);
+  int value, result;
+
+  for (value = 0; value < 3; ++value) deque__push_back_val(deque, value);
+  value = -1;
+  deque__push_front_val(deque, value);  // Now -1 0 1 2.
+  test_that(deque->count == 4);
+  test_that(deque__item_val(deque, 0, int) == -1);
+  test_that(deque__item_val(deque, 3, int) ==  2);
+
+  test_that(deque__pop_front(deque, &result) && result == -1);
+  test_that(deque__pop_back (deque, &result) && result ==  2);
+  test_that(deque__pop_back (deque, &result) && result ==  1);
+  test_that(deque__pop_front(deque, &result) && result ==  0);
+  test_that(deque->count == 0);
+  test_that(!deque__pop_front(deque, &result));
+  test_that(!deque__pop_back (deque, &result));
+
+  deque__delete(deque);
+  return test_success;
+}
+
+// Used as a FIFO queue, the deque should reuse its slots instead of growing.
+int test_fifo_reuses_slots() {
+  Deque deque = deque__new(8, sizeof(int));
+  int next_in = 0, next_out = 0;
+  for (int round = 0; round < 10000; ++round) {
+    for (int i = 0; i < 5; ++i, ++next_in) {
+      deque__push_back_val(deque, next_in);
+    }
+    int result;
+    for (int i = 0; i < 5; ++i) {
+      test_that(deque__pop_front(deque, &result));
+      test_that(result == next_out++);
+    }
+  }
+  test_that(deque->ring.count == 8);
+  deque__delete(deque);
+  return test_success;
+}
+
+// Growing a wrapped-around ring keeps items in order; check this at every
+// head position.
+int test_growth_unwraps_ring() {
+  for (int head = 0; head < 8; ++head) {
+    Deque deque = deque__new(8, sizeof(int));
+    int value = 0, result;
+    for (int i = 0; i < head; ++i) {
+      deque__push_back_val(deque, value);
+      deque__pop_front(deque, &result);
+    }
+    for (value = 0; value < 100; ++value) {
+      if (value % 2) {
+        deque__push_back_val(deque, value);
+      } else {
+        deque__push_front_val(deque, value);
+      }
+    }
+    test_that(deque->count == 100);
+    test_that(deque->ring.count == 128);
+
+    // The evens are in descending order, then the odds ascend.
+    deque__for(int *, item, deque, i) {
+      int expected = (i < 50) ? 98 - 2 * (int)i : 2 * ((int)i - 50) + 1;
+      test_that(*item == expected);
+    }
+    deque__delete(deque);
+  }
+  return test_success;
+}
+
+static int num_released = 0;
+
+void count_release(void *item, void *context) {
+  num_released++;
+}
+
+int test_releaser() {
+  Deque deque = deque__new(0, sizeof(int));
+  deque->releaser = count_release;
+  for (int i = 0; i < 10; ++i) deque__push_back_val(deque, i);
+
+  int result;
+  deque__pop_front(deque, &result);  // Copied out, so not released.
+  test_that(num_released == 0);
+  deque__pop_front(deque, NULL);
+  deque__pop_back(deque, NULL);
+  test_that(num_released == 2);
+
+  deque__clear(deque);
+  test_that(num_released == 9);
+  test_that(deque->count == 0);
+
+  for (int i = 0; i < 3; ++i) deque__push_front_val(deque, i);
+  deque__delete(deque);
+  test_that(num_released == 12);
+
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_push_and_pop, test_fifo_reuses_slots,
+            test_growth_unwraps_ring, test_releaser);
+  return end_all_tests();
+}
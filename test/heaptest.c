@@ -0,0 +1,265 @@
+// heaptest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+int compare_ints(void *context, const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  // A nonzero context reverses the order, making a max-heap.
+  if (context) return (y > x) - (y < x);
+  return (x > y) - (x < y);
+}
+
+// Pops every item, and returns 1 if they come out in the heap's order.
+int pops_in_order(Heap heap, int is_max_heap) {
+  int prev, item, in_order = 1;
+  size_t count = heap__count(heap);
+  for (size_t i = 0; i < count; ++i) {
+    if (!heap__pop(heap, &item)) return 0;
+    if (i > 0) in_order &= is_max_heap ? (item <= prev) : (item >= prev);
+    prev = item;
+  }
+  return in_order && heap__count(heap) == 0 && heap__top(heap) == NULL;
+}
+
+int test_push_and_pop() {
+  int arities[] = {2, 3, 4, 8};
+  for (int a = 0; a < 4; ++a) {
+    Heap heap = heap__new(sizeof(int), arities[a], compare_ints, NULL);
+    int least = 1 << 30;
+    srand(a);
+    for (int i = 0; i < 2000; ++i) {
+      int item = rand() % 500;
+      if (item < least) least = item;
+      test_that(heap__push_val(heap, item));
+      test_that(*(int *)heap__top(heap) == least);
+    }
+    test_that(heap__count(heap) == 2000);
+    test_that(pops_in_order(heap, 0));
+    test_that(!heap__pop(heap, NULL));
+    heap__delete(heap);
+  }
+
+  // A NULL compare function orders the items with memcmp.
+  Heap heap = heap__new(3, 2, NULL, NULL);
+  heap__push(heap, "bcd");
+  heap__push(heap, "abc");
+  heap__push(heap, "abd");
+  char item[3];
+  heap__pop(heap, item);
+  test_that(memcmp(item, "abc", 3) == 0);
+  heap__pop(heap, item);
+  test_that(memcmp(item, "abd", 3) == 0);
+  heap__delete(heap);
+
+  return test_success;
+}
+
+int test_new_from_array() {
+  Array array = array__new(0, sizeof(int));
+  for (int i = 0; i < 1000; ++i) {
+    int item = (i * 7919) % 1000;
+    array__add_item_val(array, item);
+  }
+
+  for (int arity = 2; arity <= 5; ++arity) {
+    Heap heap = heap__new_from_array(array, arity, compare_ints, NULL);
+    test_that(heap__count(heap) == 1000);
+    test_that(*(int *)heap__top(heap) == 0);
+    test_that(pops_in_order(heap, 0));
+    heap__delete(heap);
+  }
+
+  // The compare context here asks for a max-heap.
+  Heap heap = heap__new_from_array(array, 4, compare_ints, array);
+  test_that(*(int *)heap__top(heap) == 999);
+  test_that(pops_in_order(heap, 1));
+  heap__delete(heap);
+
+  test_that(array->count == 1000);
+  array__delete(array);
+  return test_success;
+}
+
+typedef struct {
+  int dist;
+  int node;
+} Entry;
+
+int compare_entries(void *context, const void *a, const void *b) {
+  return compare_ints(context, &((Entry *)a)->dist, &((Entry *)b)->dist);
+}
+
+// Runs Dijkstra's algorithm with decrease-key over a small pseudorandom graph
+// and checks the distances against Bellman-Ford.
+int test_handles() {
+  enum { num_nodes = 200, num_edges = 1000 };
+  int from[num_edges], to[num_edges], weight[num_edges];
+  srand(7);
+  for (int e = 0; e < num_edges; ++e) {
+    from[e]   = rand() % num_nodes;
+    to[e]     = rand() % num_nodes;
+    weight[e] = 1 + rand() % 100;
+  }
+
+  int expected[num_nodes];
+  for (int n = 0; n < num_nodes; ++n) expected[n] = INT32_MAX;
+  expected[0] = 0;
+  for (int round = 0; round < num_nodes; ++round) {
+    for (int e = 0; e < num_edges; ++e) {
+      if (expected[from[e]] == INT32_MAX) continue;
+      int dist = expected[from[e]] + weight[e];
+      if (dist < expected[to[e]]) expected[to[e]] = dist;
+    }
+  }
+
+  Heap heap = heap__new(sizeof(Entry), 4, compare_entries, NULL);
+  test_that(heap__use_handles(heap));
+  heap__Handle handles[num_nodes];
+  for (int n = 0; n < num_nodes; ++n) {
+    Entry entry = { n ? INT32_MAX : 0, n };
+    handles[n] = heap__push_handle(heap, &entry);
+    test_that(handles[n] != heap__no_handle);
+  }
+  test_that(heap__top_handle(heap) == handles[0]);
+
+  int dist[num_nodes];
+  Entry entry;
+  while (heap__pop(heap, &entry)) {
+    dist[entry.node] = entry.dist;
+    test_that(heap__handle_ptr(heap, handles[entry.node]) == NULL);
+    if (entry.dist == INT32_MAX) continue;
+    for (int e = 0; e < num_edges; ++e) {
+      if (from[e] != entry.node) continue;
+      Entry *other = heap__handle_ptr(heap, handles[to[e]]);
+      if (other == NULL || entry.dist + weight[e] >= other->dist) continue;
+      Entry closer = { entry.dist + weight[e], to[e] };
+      test_that(heap__decrease_key(heap, handles[to[e]], &closer));
+    }
+  }
+
+  int all_match = 1;
+  for (int n = 0; n < num_nodes; ++n) all_match &= (dist[n] == expected[n]);
+  test_that(all_match);
+
+  heap__delete(heap);
+  return test_success;
+}
+
+int test_update_and_remove() {
+  Heap heap = heap__new(sizeof(int), 3, compare_ints, NULL);
+  test_that(heap__use_handles(heap));
+  heap__Handle handles[100];
+  for (int i = 0; i < 100; ++i) handles[i] = heap__push_handle(heap, &i);
+
+  // Push every even item past all the others.
+  for (int i = 0; i < 100; i += 2) {
+    int item = 1000 + i;
+    test_that(heap__update(heap, handles[i], &item));
+    test_that(*(int *)heap__handle_ptr(heap, handles[i]) == item);
+  }
+  test_that(*(int *)heap__top(heap) == 1);
+
+  // Remove every item below 50; the odd ones are the only ones left there.
+  int item;
+  for (int i = 1; i < 50; i += 2) {
+    test_that(heap__remove(heap, handles[i], &item));
+    test_that(item == i);
+    test_that(!heap__remove(heap, handles[i], &item));
+  }
+  test_that(heap__count(heap) == 75);
+  test_that(*(int *)heap__top(heap) == 51);
+
+  // Freed handles are reused, and the handles stay consistent.
+  heap__Handle handle = heap__push_handle(heap, &(int){ -1 });
+  test_that(handle < 100);
+  test_that(heap__top_handle(heap) == handle);
+  for (int i = 50; i < 100; ++i) {
+    int *ptr = heap__handle_ptr(heap, handles[i]);
+    test_that(ptr && *ptr == (i % 2 ? i : 1000 + i));
+  }
+  test_that(pops_in_order(heap, 0));
+
+  heap__push_val(heap, item);
+  heap__clear(heap);
+  test_that(heap__count(heap) == 0);
+  heap__delete(heap);
+
+  // A heap with items can't start using handles.
+  heap = heap__new(sizeof(int), 2, compare_ints, NULL);
+  heap__push_val(heap, item);
+  test_that(!heap__use_handles(heap));
+  test_that(heap__push_handle(heap, &item) == heap__no_handle);
+  heap__delete(heap);
+
+  return test_success;
+}
+
+static int num_released = 0;
+
+void count_release(void *item, void *context) {
+  num_released++;
+}
+
+int test_releaser() {
+  Heap heap = heap__new(sizeof(int), 2, compare_ints, NULL);
+  heap->releaser = count_release;
+  for (int i = 0; i < 10; ++i) heap__push_val(heap, i);
+
+  int item;
+  heap__pop(heap, &item);
+  test_that(num_released == 0);
+  heap__pop(heap, NULL);
+  test_that(num_released == 1);
+  heap__clear(heap);
+  test_that(num_released == 9);
+  for (int i = 0; i < 10; ++i) heap__push_val(heap, i);
+  heap__delete(heap);
+  test_that(num_released == 19);
+
+  return test_success;
+}
+
+int compare_long_doubles(void *context, const void *a, const void *b) {
+  long double x = *(const long double *)a, y = *(const long double *)b;
+  return (x > y) - (x < y);
+}
+
+// Items are copied through the heap's scratch item, which must be as
+// aligned as any heap-allocated item.
+int test_aligned_scratch() {
+  Heap heap = heap__new(sizeof(long double), 4, compare_long_doubles, NULL);
+  test_that((uintptr_t)heap->scratch % array__max_align == 0);
+  for (int i = 0; i < 100; ++i) {
+    long double x = (long double)((i * 37) % 100) + 0.5L;
+    heap__push(heap, &x);
+  }
+  long double x, prev = -1;
+  int in_order = 1;
+  while (heap__pop(heap, &x)) {
+    in_order &= (x > prev);
+    prev = x;
+  }
+  test_that(in_order && prev == 99.5L);
+  heap__delete(heap);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_push_and_pop, test_new_from_array, test_handles,
+            test_update_and_remove, test_releaser, test_aligned_scratch);
+  return end_all_tests();
+}
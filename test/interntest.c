@@ -0,0 +1,104 @@
+// interntest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+int test_canonical_pointers() {
+  Intern intern = intern__new();
+
+  char buffer[16];
+  strcpy(buffer, "hostname");
+  const char *a = intern__get(intern, "hostname");
+  const char *b = intern__get(intern, buffer);
+  test_that(a == b);
+  test_that(a != buffer);
+  test_str_eq(a, "hostname");
+
+  const char *c = intern__get(intern, "metric");
+  test_that(c != a);
+  test_that(intern__count(intern) == 2);
+
+  test_that(intern__find(intern, "metric") == c);
+  test_that(intern__find(intern, "missing") == NULL);
+  test_that(intern__count(intern) == 2);
+
+  intern__delete(intern);
+  return test_success;
+}
+
+int test_pointer_keyed_map() {
+  Intern intern = intern__new();
+  Map map = map__new(intern__ptr_hash, intern__ptr_eq);
+
+  char key[16];
+  for (long i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof(key), "key%ld", i % 100);
+    map__set(map, (void *)intern__get(intern, key), (void *)i);
+  }
+  test_that(map->count == 100);
+
+  snprintf(key, sizeof(key), "key%d", 42);
+  map__key_value *pair = map__get(map, (void *)intern__get(intern, key));
+  test_that(pair != NULL);
+  test_that((long)pair->value == 942);
+
+  map__delete(map);
+  intern__delete(intern);
+  return test_success;
+}
+
+#define num_threads 4
+#define num_strs    2000
+
+static Intern shared_intern;
+static const char *results[num_threads][num_strs];
+
+static void *intern_strs(void *thread_index) {
+  long t = (long)thread_index;
+  char str[16];
+  for (int i = 0; i < num_strs; ++i) {
+    // Threads walk the strings in different orders to race on insertions.
+    int j = (t % 2) ? i : num_strs - 1 - i;
+    snprintf(str, sizeof(str), "s%d", j);
+    results[t][j] = intern__get(shared_intern, str);
+  }
+  return NULL;
+}
+
+int test_concurrent_interning() {
+  shared_intern = intern__new();
+  pthread_t threads[num_threads];
+  for (long t = 0; t < num_threads; ++t) {
+    pthread_create(&threads[t], NULL, intern_strs, (void *)t);
+  }
+  for (int t = 0; t < num_threads; ++t) pthread_join(threads[t], NULL);
+
+  test_that(intern__count(shared_intern) == num_strs);
+  for (int i = 0; i < num_strs; ++i) {
+    for (int t = 1; t < num_threads; ++t) {
+      test_that(results[t][i] == results[0][i]);
+    }
+  }
+
+  intern__delete(shared_intern);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 for additional debugging output.
+  start_all_tests(argv[0]);
+  run_tests(test_canonical_pointers, test_pointer_keyed_map,
+            test_concurrent_interning);
+  return end_all_tests();
+}
@@ -0,0 +1,196 @@
+// jointest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+typedef struct {
+  int  id;
+  int  key;
+  long value;
+} Record;
+
+#define key_offset offsetof(Record, key)
+#define key_size   sizeof(int)
+
+static Array make_records(int n, int num_keys) {
+  Array array = array__new(n, sizeof(Record));
+  for (int i = 0; i < n; ++i) {
+    Record *r = (Record *)array__new_ptr(array);
+    r->id    = i;
+    r->key   = rand() % num_keys;
+    r->value = i % 7;
+  }
+  return array;
+}
+
+typedef struct {
+  long num_matches;
+  long checksum;
+  int  num_bad_matches;
+} JoinTotals;
+
+static void count_match(void *build_item, void *probe_item, void *context) {
+  Record *b = (Record *)build_item;
+  Record *p = (Record *)probe_item;
+  JoinTotals *totals = (JoinTotals *)context;
+  if (b->key != p->key) totals->num_bad_matches++;
+  __sync_fetch_and_add(&totals->num_matches, 1);
+  __sync_fetch_and_add(&totals->checksum, (long)b->id * 31 + p->id);
+}
+
+// Compute the expected totals by counting keys on each side.
+static JoinTotals expected_totals(Array build, Array probe, int num_keys) {
+  JoinTotals totals = {0, 0, 0};
+  long *build_count = calloc(num_keys, sizeof(long));
+  long *build_ids   = calloc(num_keys, sizeof(long));
+  array__for(Record *, r, build, i) {
+    build_count[r->key]++;
+    build_ids[r->key] += r->id;
+  }
+  array__for(Record *, r, probe, i) {
+    totals.num_matches += build_count[r->key];
+    totals.checksum    += build_ids[r->key] * 31 + build_count[r->key] * r->id;
+  }
+  free(build_count);
+  free(build_ids);
+  return totals;
+}
+
+int test_small_join() {
+  Array build = array__new(4, sizeof(Record));
+  Array probe = array__new(4, sizeof(Record));
+  Record b[] = {{0, 1, 0}, {1, 2, 0}, {2, 2, 0}};
+  Record p[] = {{0, 2, 0}, {1, 3, 0}, {2, 1, 0}, {3, 2, 0}};
+  for (int i = 0; i < 3; ++i) array__add_item_val(build, b[i]);
+  for (int i = 0; i < 4; ++i) array__add_item_val(probe, p[i]);
+
+  JoinTotals totals = {0, 0, 0};
+  array__hash_join(build, probe, key_offset, key_size, count_match, &totals);
+  test_that(totals.num_matches == 5);  // Two keys of 2 each match twice.
+  test_that(totals.num_bad_matches == 0);
+
+  // Joining against an empty array produces nothing.
+  array__clear(build);
+  totals.num_matches = 0;
+  array__hash_join(build, probe, key_offset, key_size, count_match, &totals);
+  test_that(totals.num_matches == 0);
+
+  array__delete(build);
+  array__delete(probe);
+  return test_success;
+}
+
+// These are large enough to be split into many partitions.
+int test_large_join() {
+  int num_keys = 50000;
+  Array build = make_records(100000, num_keys);
+  Array probe = make_records(200000, num_keys);
+  JoinTotals expected = expected_totals(build, probe, num_keys);
+
+  JoinTotals totals = {0, 0, 0};
+  array__hash_join(build, probe, key_offset, key_size, count_match, &totals);
+  test_printf("matches=%ld expected=%ld\n", totals.num_matches,
+              expected.num_matches);
+  test_that(totals.num_matches == expected.num_matches);
+  test_that(totals.checksum == expected.checksum);
+  test_that(totals.num_bad_matches == 0);
+
+  JoinTotals par_totals = {0, 0, 0};
+  array__hash_join_parallel(build, probe, key_offset, key_size,
+                            count_match, &par_totals, 4);  // 4 --> threads
+  test_that(par_totals.num_matches == expected.num_matches);
+  test_that(par_totals.checksum == expected.checksum);
+  test_that(par_totals.num_bad_matches == 0);
+
+  array__delete(build);
+  array__delete(probe);
+  return test_success;
+}
+
+typedef struct {
+  Array sums;   // One long per group.
+  Array keys;   // The key for each group, or -1 until one is seen.
+  int   num_inconsistent;
+} GroupTotals;
+
+static void add_to_group(int group, void *item, void *context) {
+  Record *r = (Record *)item;
+  GroupTotals *totals = (GroupTotals *)context;
+  int *key = (int *)array__item_ptr(totals->keys, group);
+  if (*key == -1) *key = r->key;
+  if (*key != r->key) totals->num_inconsistent++;
+  *(long *)array__item_ptr(totals->sums, group) += r->value;
+}
+
+static int check_group_by(int num_threads) {
+  int num_keys = 30000;
+  Array records = make_records(150000, num_keys);
+
+  long *expected_sums = calloc(num_keys, sizeof(long));
+  char *key_is_used    = calloc(num_keys, sizeof(char));
+  int num_expected_groups = 0;
+  array__for(Record *, r, records, i) {
+    if (!key_is_used[r->key]) num_expected_groups++;
+    key_is_used[r->key] = 1;
+    expected_sums[r->key] += r->value;
+  }
+
+  // The first pass only counts groups.
+  int num_groups = array__group_by_parallel(records, key_offset, key_size,
+                                            NULL, NULL, num_threads);
+  test_that(num_groups == num_expected_groups);
+
+  GroupTotals totals;
+  totals.sums = array__new(num_groups, sizeof(long));
+  totals.keys = array__new(num_groups, sizeof(int));
+  totals.num_inconsistent = 0;
+  array__add_zeroed_items(totals.sums, num_groups);
+  array__add_zeroed_items(totals.keys, num_groups);
+  array__for(int *, key, totals.keys, i) *key = -1;
+
+  int num_groups2 = array__group_by_parallel(records, key_offset, key_size,
+                                             add_to_group, &totals,
+                                             num_threads);
+  test_that(num_groups2 == num_groups);
+  test_that(totals.num_inconsistent == 0);
+  array__for(long *, sum, totals.sums, group) {
+    int key = array__item_val(totals.keys, group, int);
+    test_that(key >= 0);
+    test_that(*sum == expected_sums[key]);
+  }
+
+  free(expected_sums);
+  free(key_is_used);
+  array__delete(totals.sums);
+  array__delete(totals.keys);
+  array__delete(records);
+  return test_success;
+}
+
+int test_group_by() {
+  return check_group_by(1);  // 1 --> num_threads
+}
+
+int test_parallel_group_by() {
+  return check_group_by(3);  // 3 --> num_threads
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 for additional debugging output.
+  start_all_tests(argv[0]);
+  run_tests(test_small_join, test_large_join, test_group_by,
+            test_parallel_group_by);
+  return end_all_tests();
+}
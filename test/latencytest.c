@@ -0,0 +1,107 @@
+// latencytest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "winutil.h"
+
+// Every value should land in a bucket whose reported bound is within the
+// documented relative error.
+int test_bucket_precision() {
+  LatencyHistStruct hist;
+  uint64_t values[] = {0, 1, 7, 8, 15, 16, 100, 1000, 123456789,
+                       (uint64_t)1 << 40, UINT64_MAX};
+  for (int i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    latency__hist_clear(&hist);
+    latency__hist_record(&hist, values[i]);
+    latency__hist_record(&hist, UINT64_MAX);
+    uint64_t p = latency__hist_percentile(&hist, 0.0);
+    test_printf("value=%llu reported=%llu\n",
+                (unsigned long long)values[i], (unsigned long long)p);
+    test_that(p >= values[i]);
+    test_that(p - values[i] <= values[i] >> latency__sub_bits);
+  }
+  return test_success;
+}
+
+int test_percentiles() {
+  LatencyHistStruct hist;
+  latency__hist_clear(&hist);
+  test_that(latency__hist_percentile(&hist, 50.0) == 0);
+
+  // 1000 fast operations and 10 slow ones.
+  for (int i = 0; i < 1000; ++i) latency__hist_record(&hist, 5);
+  for (int i = 0; i < 10;   ++i) latency__hist_record(&hist, 1000000);
+
+  test_that(hist.count == 1010);
+  test_that(hist.min == 5);
+  test_that(hist.max == 1000000);
+  test_that(latency__hist_percentile(&hist, 50.0) == 5);
+  test_that(latency__hist_percentile(&hist, 99.0) == 5);
+  test_that(latency__hist_percentile(&hist, 99.9) >= 1000000);
+  test_that(latency__hist_percentile(&hist, 100.0) == 1000000);
+
+  return test_success;
+}
+
+int test_merge() {
+  LatencyHistStruct a, b;
+  latency__hist_clear(&a);
+  latency__hist_clear(&b);
+  for (int i = 1; i <= 100; ++i) latency__hist_record(&a, i);
+  for (int i = 101; i <= 200; ++i) latency__hist_record(&b, i);
+
+  latency__hist_merge(&a, &b);
+  test_that(a.count == 200);
+  test_that(a.min == 1);
+  test_that(a.max == 200);
+  test_that(a.sum == 200 * 201 / 2);
+  uint64_t median = latency__hist_percentile(&a, 50.0);
+  test_that(median >= 100 && median <= 100 + (100 >> latency__sub_bits));
+
+  // Merging an empty histogram must not disturb min.
+  latency__hist_clear(&b);
+  latency__hist_merge(&a, &b);
+  test_that(a.min == 1);
+
+  return test_success;
+}
+
+int test_thread_hists() {
+  latency__reset();
+  LatencyHist hist = latency__thread_hist(latency__map_get);
+  test_that(hist->count == 0);
+  test_str_eq(latency__op_name(latency__map_get), "map__get");
+
+  Array array = array__new(1, sizeof(int));
+  for (int i = 0; i < 100; ++i) array__add_item_val(array, i);
+  array__delete(array);
+
+#ifdef LATENCY_PROFILE
+  test_that(latency__thread_hist(latency__array_new_ptr)->count == 100);
+#else
+  test_that(latency__thread_hist(latency__array_new_ptr)->count == 0);
+#endif
+
+  uint64_t before = latency__now();
+  uint64_t after  = latency__now();
+  test_that(after >= before);
+
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 for additional debugging output.
+  start_all_tests(argv[0]);
+  run_tests(test_bucket_precision, test_percentiles, test_merge,
+            test_thread_hists);
+  return end_all_tests();
+}
@@ -0,0 +1,174 @@
+// map64test.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/map64.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+// This is the 64-bit FNV-1a hash.
+uint64_t str_hash(void *str_void_ptr) {
+  unsigned char *str = (unsigned char *)str_void_ptr;
+  uint64_t h = 14695981039346656037ull;
+  while (*str) {
+    h ^= *str++;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+int str_eq(void *str1, void *str2) {
+  return !strcmp(str1, str2);
+}
+
+// Integer keys are stored directly in the key pointers.
+uint64_t int_hash(void *key) {
+  uint64_t h = (uint64_t)(uintptr_t)key;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h;
+}
+
+int int_eq(void *key1, void *key2) {
+  return key1 == key2;
+}
+
+// This hash only varies in its top four bits.
+uint64_t high_bits_hash(void *key) {
+  return (uint64_t)(uintptr_t)key << 60;
+}
+
+static int num_free_calls = 0;
+void free_with_counter(void *ptr, void *ctx) {
+  num_free_calls++;
+  free(ptr);
+}
+
+int test_set_get_unset() {
+  Map64 map = map64__new(str_hash, str_eq);
+
+  map64__set(map, "book", (void *)4L);
+  map__key_value *pair = map64__set(map, "book", (void *)5L);
+  test_that((long)pair->value == 5);
+  map64__set(map, "games", (void *)6L);
+  map64__set(map, "burger", (void *)7L);
+  test_that(map->count == 3);
+
+  test_that(map64__get(map, "games") != NULL);
+  map64__unset(map, "games");
+  test_that(map64__get(map, "games") == NULL);
+  test_that(map->count == 2);
+  map64__unset(map, "games");  // Expected to do nothing.
+  test_that(map->count == 2);
+
+  test_that((long)map64__get(map, "burger")->value == 7);
+
+  map64__delete(map);
+  return test_success;
+}
+
+int test_growth() {
+  Map64 map = map64__new(int_hash, int_eq);
+  size_t n = 200000;
+  for (size_t i = 1; i <= n; ++i) {
+    map64__set(map, (void *)(uintptr_t)i, (void *)(uintptr_t)(i * 3));
+  }
+  test_that(map->count == n);
+  test_that(map->count <= 2.5 * ((size_t)1 << map->bucket_bits));
+
+  for (size_t i = 1; i <= n; ++i) {
+    map__key_value *pair = map64__get(map, (void *)(uintptr_t)i);
+    if (pair == NULL || (uintptr_t)pair->value != i * 3) {
+      test_failed("Lookup of key %zu failed.", i);
+    }
+  }
+  test_that(map64__get(map, (void *)(uintptr_t)(n + 1)) == NULL);
+
+  size_t num_seen = 0;
+  map64__for(pair, map) {
+    test_that((uintptr_t)pair->value == 3 * (uintptr_t)pair->key);
+    ++num_seen;
+  }
+  test_that(num_seen == n);
+
+  map64__delete(map);
+  return test_success;
+}
+
+// Buckets come from the high bits of the hash.
+int test_high_bit_buckets() {
+  Map64 map = map64__new(high_bits_hash, int_eq);
+  for (uintptr_t i = 0; i < 16; ++i) map64__set(map, (void *)i, NULL);
+  test_that(map->bucket_bits == 4);
+  for (size_t i = 0; i < 16; ++i) {
+    test_that(list__count(&map->buckets[i]) == 1);
+  }
+  map64__delete(map);
+  return test_success;
+}
+
+int test_clear_and_releasers() {
+  Map64 map = map64__new(str_hash, str_eq);
+  num_free_calls = 0;
+  map->value_releaser = free_with_counter;
+
+  map64__set(map, "one", strdup("1"));
+  map64__set(map, "two", strdup("2"));
+  map64__set(map, "two", strdup("22"));
+  test_that(num_free_calls == 1);
+  map64__clear(map);
+  test_that(map->count == 0);
+  test_that(num_free_calls == 3);
+
+  map64__set(map, "five", strdup("5"));
+  test_that(map64__get(map, "five") != NULL);
+  map64__for(pair, map) test_str_eq(pair->value, "5");
+
+  map64__delete(map);
+  test_that(num_free_calls == 4);
+  return test_success;
+}
+
+int test_empty_loop() {
+  Map64 map = map64__new(str_hash, str_eq);
+  map64__for(pair, map);
+  map64__delete(map);
+  return test_success;
+}
+
+// This needs a box with well over 200 GB of memory, so it only runs when the
+// CSTRUCTS_BIG_TESTS environment variable is set.
+int test_over_three_billion_entries() {
+  if (getenv("CSTRUCTS_BIG_TESTS") == NULL) return test_success;
+
+  Map64 map = map64__new(int_hash, int_eq);
+  size_t n = 3200000000ull;
+  for (size_t i = 1; i <= n; ++i) {
+    map64__set(map, (void *)(uintptr_t)i, (void *)(uintptr_t)i);
+  }
+  test_that(map->count == n);
+  for (size_t i = 1; i <= n; i += 9973) {
+    map__key_value *pair = map64__get(map, (void *)(uintptr_t)i);
+    test_that(pair && (uintptr_t)pair->value == i);
+  }
+  map64__delete(map);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_set_get_unset, test_growth, test_high_bit_buckets,
+            test_clear_and_releasers, test_empty_loop,
+            test_over_three_billion_entries);
+  return end_all_tests();
+}
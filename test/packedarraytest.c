@@ -0,0 +1,260 @@
+// packedarraytest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+uint64_t random_u64() {
+  uint64_t x = 0;
+  for (int i = 0; i < 4; ++i) x = x << 16 ^ (uint64_t)rand();
+  return x;
+}
+
+// Returns a sorted array of n ids, starting at start, whose gaps are below
+// max_gap.
+Array sorted_ids(size_t n, size_t item_size, uint64_t start,
+                 uint64_t max_gap) {
+  Array ids = array__new(n, item_size);
+  uint64_t id = start;
+  for (size_t i = 0; i < n; ++i) {
+    id += random_u64() % max_gap;
+    if (item_size == 4) {
+      uint32_t id32 = (uint32_t)id;
+      array__add_item_val(ids, id32);
+    } else {
+      array__add_item_val(ids, id);
+    }
+  }
+  return ids;
+}
+
+uint64_t value_at(Array values, size_t i) {
+  if (values->item_size == 4) return array__item_val(values, i, uint32_t);
+  return array__item_val(values, i, uint64_t);
+}
+
+// Checks every way of reading packed against values.
+int matches(PackedArray packed, Array values) {
+  if (packed->count != values->count) return 0;
+
+  Array out = array__new(0, values->item_size);
+  int is_same = packedarray__to_array(packed, out) &&
+                out->count == values->count &&
+                memcmp(out->items, values->items,
+                       values->count * values->item_size) == 0;
+  array__delete(out);
+
+  packedarray__Cursor cursor;
+  size_t n = 0;
+  packedarray__for(packed, &cursor, value) {
+    is_same &= (value == value_at(values, n));
+    n++;
+  }
+  is_same &= (n == values->count);
+
+  for (size_t i = 0; i < values->count; i += 1 + values->count / 50) {
+    is_same &= (packedarray__get(packed, i) == value_at(values, i));
+  }
+  return is_same;
+}
+
+int test_round_trips() {
+  // Sizes around the block size leave tails of different lengths; the gaps
+  // give bit widths from 0 to the raw fallback.
+  size_t sizes[] = {0, 1, 127, 128, 129, 1000, 10000};
+  uint64_t gaps[] = {1, 2, 17, 1000, 1u << 20, 1ull << 31, 1ull << 40};
+  srand(6);
+  for (int s = 0; s < 7; ++s) {
+    for (int g = 0; g < 7; ++g) {
+      for (size_t item_size = 4; item_size <= 8; item_size += 4) {
+        Array ids = sorted_ids(sizes[s], item_size, random_u64() >> 8,
+                               gaps[g]);
+        PackedArray packed = packedarray__from_array(ids);
+        test_that(packed != NULL);
+        test_that(matches(packed, ids));
+        packedarray__delete(packed);
+        array__delete(ids);
+      }
+    }
+  }
+  return test_success;
+}
+
+int test_unsorted_values() {
+  srand(7);
+  for (size_t item_size = 4; item_size <= 8; item_size += 4) {
+    Array values = array__new(0, item_size);
+    for (int i = 0; i < 1000; ++i) {
+      // Random values, some runs that fall, and the extremes.
+      uint64_t value = (i % 300 < 100) ? random_u64() :
+                       (i % 300 < 200) ? (uint64_t)(5000 - i) :
+                       (i % 2) ? 0 : UINT64_MAX;
+      if (item_size == 4) {
+        uint32_t value32 = (uint32_t)value;
+        array__add_item_val(values, value32);
+      } else {
+        array__add_item_val(values, value);
+      }
+    }
+    PackedArray packed = packedarray__from_array(values);
+    test_that(matches(packed, values));
+    packedarray__delete(packed);
+    array__delete(values);
+  }
+  return test_success;
+}
+
+int test_find() {
+  srand(8);
+  Array ids = sorted_ids(5000, 8, 100, 10);
+  PackedArray packed = packedarray__from_array(ids);
+
+  test_that(packedarray__find(packed, 0) == 0);
+  test_that(packedarray__find(packed, UINT64_MAX) == packed->count);
+  int is_right = 1;
+  for (int k = 0; k < 2000; ++k) {
+    uint64_t value = 90 + random_u64() % 25100;
+    size_t expected = array__lower_bound_by_key(ids, 0, array__key_u64,
+                                                &value);
+    is_right &= (packedarray__find(packed, value) == expected);
+  }
+  test_that(is_right);
+
+  // Runs of equal values may span blocks.
+  PackedArray runs = packedarray__new(4);
+  for (int i = 0; i < 1000; ++i) packedarray__add(runs, i / 300);
+  test_that(packedarray__find(runs, 1) == 300);
+  test_that(packedarray__find(runs, 3) == 900);
+  test_that(packedarray__find(runs, 4) == 1000);
+  packedarray__delete(runs);
+
+  packedarray__delete(packed);
+  array__delete(ids);
+  return test_success;
+}
+
+int test_blocks_and_cursors() {
+  PackedArray packed = packedarray__new(4);
+  for (uint32_t i = 0; i < 300; ++i) packedarray__add(packed, 3 * i);
+  test_that(packedarray__num_blocks(packed) == 3);
+
+  uint32_t values[packedarray__block_size];
+  test_that(packedarray__decode_block(packed, 1, values) == 128);
+  test_that(values[0] == 3 * 128 && values[127] == 3 * 255);
+  test_that(packedarray__decode_block(packed, 2, values) == 300 - 256);
+  test_that(values[0] == 3 * 256);
+
+  packedarray__Cursor cursor;
+  uint64_t value = packedarray__start(&cursor, packed, 250);
+  int n = 0, is_right = 1;
+  for (; cursor.index < packed->count; value = packedarray__next(&cursor)) {
+    is_right &= (value == 3 * cursor.index);
+    n++;
+  }
+  test_that(is_right);
+  test_that(n == 50);
+
+  // A cursor on an empty array starts past the end.
+  PackedArray empty = packedarray__new(8);
+  test_that(packedarray__start(&cursor, empty, 0) == 0);
+  test_that(cursor.index >= empty->count);
+  test_that(packedarray__find(empty, 5) == 0);
+  packedarray__delete(empty);
+
+  test_that(packedarray__new(2) == NULL);
+  packedarray__delete(packed);
+  return test_success;
+}
+
+// The plain C decoders give the same values as the SIMD ones; on most hosts
+// they're only used when SIMD is turned off.
+int test_scalar_decoders() {
+  srand(10);
+  packedarray__use_simd(0);
+  for (size_t item_size = 4; item_size <= 8; item_size += 4) {
+    for (int g = 0; g < 3; ++g) {
+      uint64_t max_gap = (uint64_t)1 << (10 * g + 1);
+      Array ids = sorted_ids(1000, item_size, random_u64() >> 40, max_gap);
+      PackedArray packed = packedarray__from_array(ids);
+      test_that(matches(packed, ids));
+
+      // Find the first of any run of values equal to the one at 777.
+      uint64_t value = value_at(ids, 777);
+      size_t expected = 777;
+      while (expected > 0 && value_at(ids, expected - 1) == value) expected--;
+      test_that(packedarray__find(packed, value) == expected);
+      packedarray__delete(packed);
+      array__delete(ids);
+    }
+  }
+  packedarray__use_simd(1);
+  return test_success;
+}
+
+int test_compression() {
+  srand(9);
+  // Dense sorted ids take about a byte each, including block headers.
+  for (size_t item_size = 4; item_size <= 8; item_size += 4) {
+    Array ids = sorted_ids(100000, item_size, 1000000, 16);
+    PackedArray packed = packedarray__from_array(ids);
+    size_t plain_bytes = ids->count * ids->item_size;
+    test_printf("%zu-byte ids: %zu bytes packed from %zu\n", item_size,
+                packedarray__bytes(packed), plain_bytes);
+    test_that(packedarray__bytes(packed) * (item_size == 4 ? 3 : 6) <
+              plain_bytes);
+    packedarray__delete(packed);
+    array__delete(ids);
+  }
+
+  // Repeated values need no bits beyond the block headers, and evenly
+  // spaced ones need only a few.
+  PackedArray packed = packedarray__new(8);
+  for (int i = 0; i < 128 * 100; ++i) packedarray__add(packed, 12345);
+  test_that(packed->words.count == 0);
+  test_that(packedarray__get(packed, 9999) == 12345);
+  packedarray__delete(packed);
+
+  packed = packedarray__new(8);
+  for (uint64_t i = 0; i < 128 * 100; ++i) packedarray__add(packed, 7 * i);
+  packedarray__shrink_to_fit(packed);
+  test_that(packedarray__bytes(packed) < 128 * 100);
+  test_that(packedarray__get(packed, 9999) == 7 * 9999);
+  packedarray__delete(packed);
+
+  return test_success;
+}
+
+int test_nested_packed_arrays() {
+  Array lists = array__new(3, sizeof(PackedArrayStruct));
+  lists->releaser = packedarray__release_with_context;
+  for (int i = 0; i < 3; ++i) {
+    PackedArray packed = array__new_ptr(lists);
+    test_that(packedarray__init(packed, 8) != NULL);
+    for (int j = 0; j < 200 * (i + 1); ++j) packedarray__add(packed, j);
+  }
+  array__for(PackedArray, packed, lists, i) {
+    test_that(packed->count == 200 * (i + 1));
+    test_that(packedarray__get(packed, 150) == 150);
+  }
+  array__delete(lists);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_round_trips, test_unsorted_values, test_find,
+            test_blocks_and_cursors, test_scalar_decoders, test_compression,
+            test_nested_packed_arrays);
+  return end_all_tests();
+}
@@ -0,0 +1,81 @@
+// searchindextest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "winutil.h"
+
+typedef struct {
+  int64_t id;
+  double  score;
+} Row;
+
+// Compare the index against a plain scan for every count up to a limit, so
+// that every tree shape is covered.
+int test_matches_linear_scan() {
+  for (int n = 0; n < 70; ++n) {
+    Array array = array__new(n, sizeof(Row));
+    for (int i = 0; i < n; ++i) {
+      Row *row = array__new_ptr(array);
+      row->id = 2 * (i / 2) - 20;  // Even ids, each repeated twice.
+      row->score = i;
+    }
+    SearchIndex index = searchindex__new(array, offsetof(Row, id),
+                                         array__key_i64);
+    for (int64_t target = -23; target < n; ++target) {
+      size_t expected = 0;
+      while (expected < n &&
+             array__item_val(array, expected, Row).id < target) ++expected;
+      size_t found = searchindex__lower_bound(index, &target);
+      if (found != expected) {
+        test_failed("n=%d target=%lld: found %zu, expected %zu",
+                    n, (long long)target, found, expected);
+      }
+      test_that(array__lower_bound_by_key(array, offsetof(Row, id),
+                                          array__key_i64, &target) == expected);
+    }
+    searchindex__delete(index);
+    array__delete(array);
+  }
+  return test_success;
+}
+
+int test_float_keys() {
+  Array array = array__new(0, sizeof(Row));
+  for (int i = 0; i < 1000; ++i) {
+    Row *row = array__new_ptr(array);
+    row->id = i;
+    row->score = (rand() % 2000 - 1000) / 8.0;
+  }
+  array__sort_by_key(array, offsetof(Row, score), array__key_f64);
+  SearchIndex index = searchindex__new(array, offsetof(Row, score),
+                                       array__key_f64);
+
+  double targets[] = {-200.0, -0.5, 0.0, 3.125, 124.875, 500.0};
+  for (int t = 0; t < sizeof(targets) / sizeof(targets[0]); ++t) {
+    size_t i = searchindex__lower_bound(index, &targets[t]);
+    test_that(i == 0 || array__item_val(array, i - 1, Row).score < targets[t]);
+    test_that(i == array->count ||
+              array__item_val(array, i, Row).score >= targets[t]);
+  }
+
+  searchindex__delete(index);
+  array__delete(array);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 for additional debugging output.
+  start_all_tests(argv[0]);
+  run_tests(test_matches_linear_scan, test_float_keys);
+  return end_all_tests();
+}
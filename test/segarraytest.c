@@ -0,0 +1,99 @@
+// segarraytest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "winutil.h"
+
+int test_add_and_index() {
+  SegArray seg_array = segarray__new(4, sizeof(int));
+  test_that(seg_array->count == 0);
+  test_that(seg_array->num_segments == 0);
+
+  for (int i = 0; i < 1000; ++i) segarray__add_item_val(seg_array, i);
+  test_that(seg_array->count == 1000);
+  // Segments of 4, 8, ..., 512 items hold 1020 items.
+  test_that(seg_array->num_segments == 8);
+
+  int all_match = 1;
+  for (size_t i = 0; i < 1000; ++i) {
+    all_match &= (segarray__item_val(seg_array, i, int) == (int)i);
+  }
+  test_that(all_match);
+
+  size_t num_seen = 0;
+  segarray__for(int *, item, seg_array, i) {
+    test_that(*item == (int)i);
+    num_seen++;
+  }
+  test_that(num_seen == 1000);
+
+  segarray__delete(seg_array);
+  return test_success;
+}
+
+// Pointers to items should survive any amount of later growth.
+int test_stable_pointers() {
+  SegArray seg_array = segarray__new(1, sizeof(double));
+  double *first = segarray__new_ptr(seg_array);
+  *first = 1.5;
+  double *pointers[100];
+  for (int i = 0; i < 100; ++i) {
+    pointers[i] = segarray__new_ptr(seg_array);
+    *pointers[i] = i;
+  }
+  for (int i = 0; i < 100000; ++i) segarray__new_val(seg_array, double) = -1;
+
+  test_that(*first == 1.5);
+  test_that(first == segarray__item_ptr(seg_array, 0));
+  for (int i = 0; i < 100; ++i) {
+    test_that(*pointers[i] == i);
+    test_that(pointers[i] == segarray__item_ptr(seg_array, i + 1));
+  }
+
+  segarray__delete(seg_array);
+  return test_success;
+}
+
+static int num_released = 0;
+
+void count_release(void *item, void *context) {
+  num_released++;
+}
+
+int test_clear_and_reuse() {
+  SegArray seg_array = segarray__new(0, sizeof(int));
+  seg_array->releaser = count_release;
+  for (int i = 0; i < 100; ++i) segarray__add_item_val(seg_array, i);
+  int num_segments = seg_array->num_segments;
+  int *item_50 = segarray__item_ptr(seg_array, 50);
+
+  segarray__clear(seg_array);
+  test_that(num_released == 100);
+  test_that(seg_array->count == 0);
+  test_that(seg_array->num_segments == num_segments);
+
+  // The segments are reused, so item 50 lands in the same place.
+  for (int i = 0; i < 100; ++i) segarray__add_item_val(seg_array, i);
+  test_that(segarray__item_ptr(seg_array, 50) == item_50);
+  test_that(seg_array->num_segments == num_segments);
+
+  segarray__delete(seg_array);
+  test_that(num_released == 200);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_add_and_index, test_stable_pointers, test_clear_and_reuse);
+  return end_all_tests();
+}
@@ -0,0 +1,269 @@
+// sortedsettest.c
+//
+// https://github.com/tylerneylon/cstructs
+//
+
+#include "cstructs/cstructs.h"
+
+#include "ctest.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "winutil.h"
+
+typedef struct {
+  int64_t key;
+  int     source;
+  int     index;
+} Record;
+
+int compare_records(void *context, const void *a, const void *b) {
+  int64_t x = ((const Record *)a)->key, y = ((const Record *)b)->key;
+  return (x > y) - (x < y);
+}
+
+// Returns a sorted array of n records whose keys are drawn from [0, range)
+// and then shifted by offset, so that they may be negative.
+Array random_records(size_t n, int64_t range, int64_t offset, int source) {
+  Array array = array__new(n, sizeof(Record));
+  for (size_t i = 0; i < n; ++i) {
+    Record *r = array__new_ptr(array);
+    r->key    = (int64_t)(((uint64_t)rand() << 16 ^ rand()) % range) + offset;
+    r->source = source;
+  }
+  array__sort(array, compare_records, NULL);
+  for (size_t i = 0; i < n; ++i) {
+    array__item_val(array, i, Record).index = (int)i;
+  }
+  return array;
+}
+
+// Copies each record's key into a new array of the given key type.
+Array keys_of(Array records, array__KeyType type) {
+  int is_wide = (type == array__key_i64 || type == array__key_u64);
+  Array keys = array__new(records->count, is_wide ? 8 : 4);
+  array__for(Record *, r, records, i) {
+    if (is_wide) {
+      int64_t key = r->key;
+      array__add_item_val(keys, key);
+    } else {
+      int32_t key = (int32_t)r->key;
+      array__add_item_val(keys, key);
+    }
+  }
+  return keys;
+}
+
+// The reference versions of the operations, by brute force. Each returns a
+// new array of the records kept.
+Array naive_set_op(Array a, Array b, int op) {
+  Array out = array__new(0, sizeof(Record));
+  array__for(Record *, r, a, i) {
+    int is_in_b = 0;
+    array__for(Record *, s, b, j) is_in_b |= (r->key == s->key);
+    if (op == 'u' || (op == 'i') == is_in_b) array__add_item_ptr(out, r);
+  }
+  if (op == 'u') {
+    array__for(Record *, s, b, j) {
+      int is_in_a = 0;
+      array__for(Record *, r, a, i) is_in_a |= (r->key == s->key);
+      if (!is_in_a) array__add_item_ptr(out, s);
+    }
+    array__sort(out, compare_records, NULL);
+  }
+  return out;
+}
+
+int same_keys(Array records, Array keys, array__KeyType type) {
+  Array expected = keys_of(records, type);
+  int is_same = (expected->count == keys->count) &&
+                memcmp(expected->items, keys->items,
+                       keys->count * keys->item_size) == 0;
+  array__delete(expected);
+  return is_same;
+}
+
+int same_records(Array expected, Array actual) {
+  if (expected->count != actual->count) return 0;
+  for (size_t i = 0; i < expected->count; ++i) {
+    Record *x = array__item_ptr(expected, i), *y = array__item_ptr(actual, i);
+    if (x->key != y->key) return 0;
+  }
+  return 1;
+}
+
+int test_set_ops() {
+  // Sizes that are equal, similar, and far apart, so that both the block
+  // kernels and galloping are used.
+  size_t sizes[][2] = {
+    {0, 0}, {0, 10}, {10, 0}, {1, 1}, {7, 9}, {100, 100}, {1000, 1200},
+    {3000, 20}, {20, 3000}, {5000, 5000}
+  };
+  array__KeyType types[] = {
+    array__key_i32, array__key_u32, array__key_i64, array__key_u64
+  };
+  srand(1);
+  for (int s = 0; s < 10; ++s) {
+    for (int t = 0; t < 4; ++t) {
+      // Small ranges give duplicates; signed types also get negative keys.
+      int64_t range  = (s % 2) ? 2 * (int64_t)(sizes[s][0] + sizes[s][1]) + 1
+                               : 1000000;
+      int is_signed  = (types[t] == array__key_i32 ||
+                        types[t] == array__key_i64);
+      int64_t offset = is_signed ? -range / 2 : 0;
+      Array a = random_records(sizes[s][0], range, offset, 0);
+      Array b = random_records(sizes[s][1], range, offset, 1);
+      Array a_keys = keys_of(a, types[t]), b_keys = keys_of(b, types[t]);
+
+      const char *ops = "iud";
+      for (int o = 0; o < 3; ++o) {
+        Array expected = naive_set_op(a, b, ops[o]);
+        Array out     = array__new(0, sizeof(Record));
+        Array out_key = array__new(0, a_keys->item_size);
+        int (*by_compare)(Array, Array, Array, array__CompareFunction,
+                          void *) =
+            (o == 0) ? array__sorted_intersect :
+            (o == 1) ? array__sorted_union : array__sorted_difference;
+        int (*by_key)(Array, Array, Array, size_t, array__KeyType) =
+            (o == 0) ? array__sorted_intersect_by_key :
+            (o == 1) ? array__sorted_union_by_key :
+                       array__sorted_difference_by_key;
+
+        test_that(by_compare(out, a, b, compare_records, NULL));
+        test_that(same_records(expected, out));
+        array__clear(out);
+        test_that(by_key(out, a, b, offsetof(Record, key), array__key_i64));
+        test_that(same_records(expected, out));
+        test_that(by_key(out_key, a_keys, b_keys, 0, types[t]));
+        test_that(same_keys(expected, out_key, types[t]));
+
+        array__delete(expected);
+        array__delete(out);
+        array__delete(out_key);
+      }
+      array__delete(a);
+      array__delete(b);
+      array__delete(a_keys);
+      array__delete(b_keys);
+    }
+  }
+  return test_success;
+}
+
+int test_memcmp_order() {
+  Array a = array__new(0, 4), b = array__new(0, 4), out = array__new(0, 4);
+  const char *a_items[] = {"abc", "bcd", "cde", "xyz"};
+  const char *b_items[] = {"bcd", "cdf", "xyz"};
+  for (int i = 0; i < 4; ++i) array__add_item_ptr(a, (void *)a_items[i]);
+  for (int i = 0; i < 3; ++i) array__add_item_ptr(b, (void *)b_items[i]);
+
+  test_that(array__sorted_intersect(out, a, b, NULL, NULL));
+  test_that(out->count == 2);
+  test_that(strcmp(array__item_ptr(out, 1), "xyz") == 0);
+
+  // Results are appended to what out already holds.
+  test_that(array__sorted_difference(out, a, b, NULL, NULL));
+  test_that(out->count == 4);
+  test_that(strcmp(array__item_ptr(out, 2), "abc") == 0);
+  test_that(strcmp(array__item_ptr(out, 3), "cde") == 0);
+
+  array__clear(out);
+  test_that(array__sorted_union(out, a, b, NULL, NULL));
+  test_that(out->count == 5);
+  test_that(strcmp(array__item_ptr(out, 3), "cdf") == 0);
+
+  array__delete(a);
+  array__delete(b);
+  array__delete(out);
+  return test_success;
+}
+
+// Intersect keeps every duplicate in a that matches b, so its result can
+// be longer than b.
+int test_duplicate_keys() {
+  for (size_t width = 4; width <= 8; width += 4) {
+    array__KeyType type = (width == 4) ? array__key_u32 : array__key_u64;
+    Array a = array__new(0, width), b = array__new(0, width);
+    uint32_t five32 = 5;
+    uint64_t five64 = 5;
+    void *five = (width == 4) ? (void *)&five32 : (void *)&five64;
+    for (int i = 0; i < 100; ++i) array__add_item_ptr(a, five);
+
+    // One copy in b takes the galloping path; ten use the block kernels.
+    for (size_t nb = 1; nb <= 10; nb += 9) {
+      while (b->count < nb) array__add_item_ptr(b, five);
+      for (int by_key = 0; by_key < 2; ++by_key) {
+        Array out = array__new(0, width);
+        if (by_key) {
+          test_that(array__sorted_intersect_by_key(out, a, b, 0, type));
+        } else {
+          test_that(array__sorted_intersect(out, a, b, NULL, NULL));
+        }
+        test_that(out->count == 100);
+        test_that(memcmp(out->items, a->items, 100 * width) == 0);
+        array__delete(out);
+      }
+    }
+    array__delete(a);
+    array__delete(b);
+  }
+  return test_success;
+}
+
+int test_merge_sorted() {
+  Array arrays[6];
+  size_t sizes[] = {100, 0, 1, 2000, 50, 700};
+  size_t total = 0;
+  srand(2);
+  for (int k = 0; k < 6; ++k) {
+    // Some inputs cover a narrow range, so that whole runs get copied.
+    int64_t range = (k == 3) ? 40 : 5000;
+    arrays[k] = random_records(sizes[k], range, k == 3 ? 2000 : 0, k);
+    total += sizes[k];
+  }
+
+  for (int by_key = 0; by_key < 2; ++by_key) {
+    Array out = array__new(0, sizeof(Record));
+    if (by_key) {
+      test_that(array__merge_sorted_by_key(out, arrays, 6,
+                                           offsetof(Record, key),
+                                           array__key_i64));
+    } else {
+      test_that(array__merge_sorted(out, arrays, 6, compare_records, NULL));
+    }
+    test_that(out->count == total);
+
+    // Equal keys are ordered by source, then by their order in the source.
+    int is_stable = 1;
+    for (size_t i = 1; i < out->count; ++i) {
+      Record *prev = array__item_ptr(out, i - 1);
+      Record *r    = array__item_ptr(out, i);
+      is_stable &= (prev->key < r->key) ||
+                   (prev->key == r->key &&
+                    (prev->source < r->source ||
+                     (prev->source == r->source && prev->index < r->index)));
+    }
+    test_that(is_stable);
+    array__delete(out);
+  }
+
+  Array out = array__new(0, sizeof(Record));
+  test_that(array__merge_sorted(out, arrays, 0, compare_records, NULL));
+  test_that(out->count == 0);
+  array__delete(out);
+
+  for (int k = 0; k < 6; ++k) array__delete(arrays[k]);
+  return test_success;
+}
+
+int main(int argc, char **argv) {
+  set_verbose(0);  // Set this to 1 while debugging a test.
+  start_all_tests(argv[0]);
+  run_tests(test_set_ops, test_memcmp_order, test_duplicate_keys,
+            test_merge_sorted);
+  return end_all_tests();
+}